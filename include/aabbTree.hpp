@@ -0,0 +1,100 @@
+#ifndef __AABBTREE_H__
+#define __AABBTREE_H__
+
+#include <vector>
+#include "utility.hpp"
+#include "frustum.hpp"
+
+/*
+  Dynamic bounding volume hierarchy over world space boxes. Leaves store a
+  slightly enlarged ("fat") box, so objects moving a little only cost a
+  containment check in move(). Leaves are inserted next to the sibling that
+  grows the tree's surface area the least, and the tree is kept balanced
+  with AVL style rotations while refitting the ancestors.
+
+  Leaf ids stay valid until remove(), nodes live in one vector and are
+  recycled through a free list.
+*/
+class AABBTree
+{
+public:
+  // returns the leaf id
+  int insert(const AABB &box, int userData);
+  void remove(int leaf);
+  // refits the leaf when 'box' left its fat box, returns true when it did
+  bool move(int leaf, const AABB &box);
+
+  int userData(int leaf) const { return nodes[leaf].userData; }
+  const AABB &fatBox(int leaf) const { return nodes[leaf].box; }
+  int height() const { return root < 0 ? 0 : nodes[root].height; }
+  void clear();
+
+  // Calls visit(userData) for every leaf whose fat box touches the frustum.
+  // Subtrees fully inside are reported without testing their nodes.
+  template <typename Visit>
+  void query(const Frustum &frustum, Visit &&visit)
+  {
+    if (root < 0)
+      return;
+
+    stack.clear();
+    stack.push_back({root, false});
+    while (!stack.empty())
+    {
+      StackEntry e = stack.back();
+      stack.pop_back();
+      const Node &n = nodes[e.node];
+
+      bool inside = e.inside;
+      if (!inside)
+      {
+        Frustum::Side side = frustum.classify(n.box);
+        if (side == Frustum::outside)
+          continue;
+        inside = side == Frustum::inside;
+      }
+
+      if (n.isLeaf())
+      {
+        visit(n.userData);
+        continue;
+      }
+      stack.push_back({n.right, inside});
+      stack.push_back({n.left, inside});
+    }
+  }
+
+private:
+  struct Node
+  {
+    AABB box;
+    int parent = -1;
+    int left = -1;
+    int right = -1;
+    int height = 0; // 0 for leaves, -1 for free nodes
+    int userData = -1;
+    int next = -1; // free list link
+
+    bool isLeaf() const { return left < 0; }
+  };
+
+  struct StackEntry
+  {
+    int node;
+    bool inside;
+  };
+
+  int allocate();
+  void release(int node);
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+  void refit(int node);
+  int balance(int node);
+
+  std::vector<Node> nodes;
+  std::vector<StackEntry> stack;
+  int root = -1;
+  int freeList = -1;
+};
+
+#endif // __AABBTREE_H__
@@ -0,0 +1,128 @@
+#ifndef __ASSETPACK_H__
+#define __ASSETPACK_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "utility.hpp"
+
+/*
+  Cooked asset pack, written by the cooker tool (src/cooker.cpp) and memory
+  mapped by the engine. Meshes and textures are stored in the exact layout
+  the engine uses, so loading only points MeshData/Texture at the mapped data.
+
+    PackHeader
+    PackEntry[entryCount]
+    names, then per entry a PackMeshHeader or PackTextureHeader and its arrays
+
+  Offsets are from the start of the file, arrays are 64 byte aligned. Packs
+  are only valid for the version (and endianness) that wrote them.
+*/
+
+static constexpr uint32_t PACK_MAGIC = 0x50315350; // "PS1P"
+static constexpr uint32_t PACK_VERSION = 1;
+static constexpr uint64_t PACK_ALIGN = 64;
+
+enum PackEntryType : uint32_t
+{
+  PACK_MESH = 1,
+  PACK_TEXTURE = 2,
+};
+
+struct PackHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t reserved;
+  uint64_t fileSize;
+};
+
+struct PackEntry
+{
+  uint32_t type;
+  uint32_t nameLength;
+  uint64_t nameOffset;
+  uint64_t offset; // PackMeshHeader or PackTextureHeader
+};
+
+struct PackMeshHeader
+{
+  AABB aabb;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t centered;
+  uint32_t reserved;
+  uint64_t xOffset;
+  uint64_t yOffset;
+  uint64_t zOffset;
+  uint64_t uvOffset; // UV[vertexCount]
+  uint64_t indexOffset;
+};
+
+struct PackTextureHeader
+{
+  int32_t width;
+  int32_t height;
+  uint32_t layout; // Texture::Layout
+  uint32_t quantized;
+  uint64_t texelOffset;
+  uint64_t texelCount;
+};
+
+struct MeshData;
+struct Texture;
+
+// Read-only view of a pack file, mapped for the lifetime of the object
+class AssetPack
+{
+public:
+  AssetPack();
+  ~AssetPack();
+  AssetPack(const AssetPack &) = delete;
+  AssetPack &operator=(const AssetPack &) = delete;
+
+  // Fails on a bad header or on any entry whose arrays reach past the file,
+  // nothing is used from such packs. Only the headers are read here.
+  bool open(const std::string &filename);
+  void close();
+  bool isOpen() const { return data != nullptr; }
+
+  const PackMeshHeader *findMesh(const std::string &name) const;
+  const PackTextureHeader *findTexture(const std::string &name) const;
+  // true when no index reaches past the mesh's vertices. Reads the whole index
+  // array, so it runs when a mesh is loaded rather than in open().
+  bool indicesValid(const PackMeshHeader &mesh) const;
+
+  template <typename T>
+  const T *at(uint64_t offset) const { return reinterpret_cast<const T *>(data + offset); }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  std::unordered_map<std::string, const PackEntry *> meshes;
+  std::unordered_map<std::string, const PackEntry *> textures;
+};
+
+// Builds a pack in memory and writes it in one go, used by the cooker
+class AssetPackWriter
+{
+public:
+  void addMesh(const std::string &name, const MeshData &mesh, bool centered);
+  void addTexture(const std::string &name, const Texture &texture, bool quantized);
+  bool write(const std::string &filename) const;
+
+private:
+  struct Item
+  {
+    uint32_t type;
+    std::string name;
+    std::vector<uint8_t> blob; // header followed by arrays, offsets relative to the blob
+  };
+
+  std::vector<Item> items;
+};
+
+#endif // __ASSETPACK_H__
@@ -6,20 +6,30 @@
 #include "meshManager.hpp"
 #include "transform.hpp"
 
-class Component;
-
 class Component
 {
 public:
   Component();
   ~Component();
 
-  bool createMeshFromFile(std::string filename, int textureID, bool centerMesh = true);
+  bool createMeshFromFile(std::string filename, int textureID, bool centerMesh = true,
+                          const AssetPack *pack = nullptr, MeshCache *cache = nullptr);
   Meshes meshes;
   Transform transform;
+  // rasterized into the occlusion buffer every frame it is visible
+  bool occluder = false;
+  // index in Components::components, -1 for roots, see Components::setParent()
+  int parent = -1;
 
-private:
-  Component *child;
+  // World space boxes of the meshes and of all of them together, kept by
+  // Components::updateWorld(). hasBounds is false while no mesh has triangles.
+  std::vector<AABB> meshWorldBoxes;
+  AABB worldBox;
+  bool hasBounds = false;
+  // matWorld or the boxes changed in the last updateWorld()
+  bool worldChanged = true;
+  // meshes the boxes were computed for
+  std::vector<const MeshData *> boundMeshes;
 };
 
 #endif // __COMPONENT_H__
\ No newline at end of file
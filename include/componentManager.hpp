@@ -7,8 +7,27 @@
 struct Components
 {
   std::vector<Component> components;
+  // meshes are looked up here first when set, see Engine::LoadPack()
+  const AssetPack *pack = nullptr;
+  // shares geometry between components loading the same file
+  MeshCache *meshCache = nullptr;
   bool createFromFile(std::string filename, int textureID, Vec3 pos, bool centerComponent = true);
   Component &getOrCreate(uint32_t ID);
+
+  // Moves 'child' into the space of 'parent', -1 makes it a root again.
+  // Fails for indices out of range and when it would create a cycle.
+  bool setParent(int child, int parent);
+  // Rebuilds world matrices and boxes of components that changed, their
+  // descendants, and components whose meshes were replaced. Parents are
+  // updated before their children, untouched components cost a flag check.
+  void updateWorld();
+
+private:
+  void sortHierarchy();
+
+  // parents before children
+  std::vector<int> updateOrder;
+  bool hierarchyChanged = true;
 };
 
 #endif // __COMPONENTMANAGER_H__
\ No newline at end of file
@@ -16,6 +16,10 @@
 #include <list>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
 
 
 #include <SFML/Graphics.hpp>
@@ -23,6 +27,12 @@
 #include "utility.hpp"
 #include "componentManager.hpp"
 #include "camera.hpp"
+#include "threadPool.hpp"
+#include "texture.hpp"
+#include "fixed.hpp"
+#include "assetPack.hpp"
+#include "aabbTree.hpp"
+#include "occlusionBuffer.hpp"
 
 struct TextureMetadata {
     int width;
@@ -33,47 +43,228 @@ struct TextureMetadata {
     std::string filename;
 };
 
+// Result of an asynchronous load. id is the texture id or component index,
+// usable right away. ready turns true once the asset is published between
+// frames, or false when loading failed.
+struct AssetRequest {
+    int id;
+    std::shared_future<bool> ready;
+
+    bool isReady() const { return ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+};
+
+// Per visible mesh matrices, concatenated once per frame
+struct MeshTransform {
+    mat4x4 worldView;
+    mat4x4 worldViewProj;
+};
+
+// Screen space extent of a projected AABB in pixels, nearestW is the largest
+// 1/z of its corners
+struct ProjectedBounds {
+    float minX, minY;
+    float maxX, maxY;
+    float nearestW;
+};
+
+// Range of mesh vertices or triangles handled by one geometry worker.
+// vertexBase is where the mesh starts in the transformed vertex streams.
+struct GeometryJob {
+    const Mesh *mesh;
+    const MeshData *lod; // level of detail picked for this frame
+    size_t first;
+    size_t last;
+    size_t vertexBase;
+    size_t transform;
+};
+
+// Pixel rectangle, x0/y0 inclusive and x1/y1 exclusive
+struct ScreenRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Start values and per-row steps of one triangle edge
+struct EdgeWalk {
+    float x, u, v, w;
+    float dx, du, dv, dw;
+};
+
+// One scanline of a triangle, pixels ax <= x < bx
+struct SpanRow {
+    int ax;
+    int bx;
+    float u_s, v_s, w_s;
+    float u_e, v_e, w_e;
+};
+
+// Evaluates both edges 'row' rows below their start for the span ax..bx, which
+// comes from the triangle's edge functions. Shared by every texture mapping
+// mode of the scanline kernel so they agree on coverage pixel for pixel.
+inline void spanAtRow(const EdgeWalk &e1, const EdgeWalk &e2, float row, int ax, int bx, SpanRow &s)
+{
+    s.ax = ax;
+    s.bx = bx;
+    s.u_s = e1.u + row * e1.du;
+    s.v_s = e1.v + row * e1.dv;
+    s.w_s = e1.w + row * e1.dw;
+    s.u_e = e2.u + row * e2.du;
+    s.v_e = e2.v + row * e2.dv;
+    s.w_e = e2.w + row * e2.dw;
+
+    if (e1.x + row * e1.dx > e2.x + row * e2.dx)
+    {
+        std::swap(s.u_s, s.u_e);
+        std::swap(s.v_s, s.v_e);
+        std::swap(s.w_s, s.w_e);
+    }
+}
+
 class Engine
 {
 public:
-  Engine(int targetFPS = 60, float scale = 1, const char *title = "Unknow app");
+  Engine(int targetFPS = 60, float scale = 1, const char *title = "Unknow app", bool headless = false);
   ~Engine();
 
+  // one frame buffer pixel, bytes r, g, b, a in memory like sf::Image
+  static uint32_t packPixel(uint8_t r, uint8_t g, uint8_t b)
+  {
+    return r | (g << 8) | (b << 16) | 0xFF000000u;
+  }
   inline void setPixel(int x, int y, Color &color);
   inline Color getPixelFrom(int x, int y, uint8_t *buffer);
   inline void setPixelTo(int x, int y, Color &color, uint8_t *buffer);
 
-  int LoadTexture(std::string filename);
+  // Maps a cooked pack (see src/cooker.cpp). Meshes and textures found in it are
+  // used in place by createFromFile() and LoadTexture(), the rest load from disk.
+  // Call it before loading assets: it waits for loads in flight, and assets already
+  // mapped from a previously loaded pack must be released before it is replaced.
+  bool LoadPack(const std::string &filename);
+  int LoadTexture(std::string filename, Texture::Layout layout = Texture::linear);
+
+  // Background loading on the loader threads. Results are published at the start of
+  // calculateTriangles(). Components render once their mesh is published, with flat
+  // colour while their texture is still loading.
+  AssetRequest LoadTextureAsync(const std::string &filename, Texture::Layout layout = Texture::linear);
+  AssetRequest LoadComponentAsync(const std::string &filename, int textureID, Vec3 pos, bool centerComponent = true);
+  // blocks until every load in flight is done, then publishes them
+  void waitForLoads();
+
+  // Loading the same file again shares the cached asset. Unused assets are evicted,
+  // least recently used first, while a cache is over its budget (0 = unlimited).
+  void setResourceBudget(size_t meshBytes, size_t textureBytes);
+  // drops the id's reference, the id renders untextured afterwards
+  void releaseTexture(int textureID);
   void QuantizeImage(sf::Image &img);
 
   void drawLine(int sx, int sy, int ex, int ey, Color color);
-  void drawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Color color);
-  void fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color);
+  void drawLine(int sx, int sy, int ex, int ey, Color color, const ScreenRect &clip);
+  void drawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Color color, const ScreenRect &clip);
+  void fillTriangle(Vec3 t1, Vec3 t2, Vec3 t3, Color color, const ScreenRect &clip);
   void texturedTriangle(Vec3 &t1, UV &uv1, float w1,
                         Vec3 &t2, UV &uv2, float w2,
                         Vec3 &t3, UV &uv3, float w3,
-                        sf::Image &img, Color &color);
+                        const Texture &texture, Color &color, const ScreenRect &clip);
+  // integer kernel for triangles from the fixed point geometry stage
+  void texturedTriangleFixed(const Triangle &tri, const Texture &texture, const Color &color, const ScreenRect &clip);
 
   void renderTriangle(Triangle &triangle, int textureID = 0);
+  // only touches pixels inside clip, safe to call for disjoint clips in parallel
+  void renderTriangle(Triangle &triangle, int textureID, const ScreenRect &clip);
 
   bool isOpen();
   void checkEvents();
   void render(int debugMode);
-  void copyVideoBuffer(uint8_t *buffer);
-  void ClearDepthBufferWithSIMD(float* pDepthBuffer, size_t size);
+  // Starts the next frame. Nothing is cleared in full: a tile's depth is reset
+  // when the first triangle of the frame touches it, and only tiles drawn since
+  // the previous clear() get the clear colour back. render() calls it, windowed
+  // after presenting the frame, headless before drawing the next one.
   void clear();
+  // Off when something drawn every frame covers the whole screen (a background
+  // or sky pass), clear() then leaves the colour buffer alone.
+  void setColorClear(bool v);
+  // both read videoBuffer and write videoBufferBack
+  void Dither_Ordered();
   void Dither_FloydSteinberg();
   void rasterize();
   void renderAll();
   void calculateTriangles(Vec3 &camera, Vec3 &vTarget, Vec3 &vUp);
+  // Pipelined, calculateTriangles() hands the frame's geometry to a background
+  // thread and takes the triangles it built during the previous frame, so
+  // render() rasterizes frame N while frame N + 1 is transformed. That is one
+  // frame of latency, the first pipelined frame draws nothing. Camera and
+  // transforms are read inside calculateTriangles(), they may change afterwards.
+  void setPipelined(bool v);
+  // frames passed to calculateTriangles() so far, and the one whose triangles
+  // are in vecTrianglesToRaster; the difference is the latency in frames
+  uint64_t getSubmittedFrame() const;
+  uint64_t getDisplayedFrame() const;
   void setSort(bool b);
+
+  // How setSort() orders triangles back to front, both are stable counting sorts
+  // on keys computed by the geometry jobs.
+  enum SortMethod
+  {
+    orderingTable, // PS1 style depth buckets, linear in view z up to the far plane
+    radix,         // exact average depth, two 16-bit radix passes
+  };
+  // orderingTableSize is the bucket count, 1 to 65536
+  void setSortMethod(SortMethod method, int orderingTableSize = 4096);
   void setDither(bool v);
+
+  // What setDither() does to the frame, both quantize to RGB555 like the PS1.
+  enum DitherMode
+  {
+    ordered,        // PS1 GPU 4x4 ordered dither, SIMD, rows in parallel
+    floydSteinberg, // error diffusion, rows in parallel as a wavefront
+  };
+  void setDitherMode(DitherMode mode);
   void setFogColor(const Color& new_color);
+  void setTiledRaster(bool v);
+  void setGuardBand(bool v);
+  // integer transform, clipping and raster: 16.16 clip space, 12.4 snapped
+  // vertices, 16.16 affine interpolation and depth
+  void setFixedPoint(bool v);
 
-  bool checkIfAABBisOnScreen(AABB &aabb, mat4x4 &matWorld, mat4x4 &matView);
+  enum RasterKernel
+  {
+    scanline,
+    halfSpace, // SIMD edge functions over 8x8 tiles of 2x2 (SSE) or 4x2 (AVX2) pixel blocks
+  };
+  void setRasterKernel(RasterKernel kernel);
+
+  enum TextureMapping
+  {
+    exact,      // perspective-correct u/v at every pixel
+    subdivided, // exact every spanLength pixels, linear in between
+    affine,     // exact at span ends only, PS1 style warping
+  };
+  // scanline kernel only, spanLength is used by 'subdivided' (8 or 16 work well)
+  void setTextureMapping(TextureMapping mode, int spanLength = 16);
+  // samples each textured triangle from the mip level closest to one texel per pixel
+  void setMipmapping(bool v);
+  // Mesh lods are picked so each triangle covers about LOD_PIXELS_PER_TRIANGLE pixels
+  // of the mesh's projected AABB. The bias is added in levels: positive is coarser.
+  void setLodBias(float bias);
+  // Meshes whose screen box lies behind the occluders' depth are skipped before
+  // their geometry is processed. Occluders are the components marked 'occluder'
+  // plus the meshes covering the most of the screen.
+  void setOcclusionCulling(bool v);
+
+  // Final image of the last render() as RGBA, r first and alpha 255 (width * height * 4 bytes).
+  // In headless mode this is the only output, it stays valid until the next clear().
+  const uint8_t *getFrameBuffer() const;
+  bool isHeadless() const;
 
   float getClock();
 
+  // declared before everything that may point into it
+  AssetPack pack;
+  // shared geometry and texels, see setResourceBudget()
+  MeshCache meshCache;
+  ResourceCache<Texture> textureCache;
   Components components;
 
   mat4x4 matProj;
@@ -81,13 +272,54 @@ public:
   int width;
   int height;
 
-  std::vector<sf::Image> textureImage;
+  // texture id -> shared texture, null while loading or after releaseTexture()
+  std::vector<std::shared_ptr<const Texture>> textures;
   std::vector<TextureMetadata> textureMetadata;
 
   std::vector<Triangle> vecTrianglesToRaster;
 
+  static constexpr int TILE_SIZE = 32;
+  // pixels past each screen edge that the rasterizers clamp instead of clipping
+  static constexpr int GUARD_BAND = 1024;
+  static constexpr int MAX_CLIPPED_TRIANGLES = 16;
+  // vertices or triangles per geometry job, small enough to balance one big mesh across workers
+  static constexpr size_t GEOMETRY_CHUNK = 2048;
+  static constexpr unsigned LOADER_THREADS = 2;
+  static constexpr float LOD_PIXELS_PER_TRIANGLE = 2.0f;
+  // screen pixels per occlusion buffer texel, along each axis
+  static constexpr int OCCLUSION_SCALE = 2;
+  static constexpr int MAX_OCCLUDERS = 16;
+  // automatically picked occluders cover at least this fraction of the screen
+  static constexpr float OCCLUDER_MIN_AREA = 0.02f;
+  // rows per ordered dither job, pixels a Floyd-Steinberg row runs ahead of the next
+  static constexpr int DITHER_ROWS = 16;
+  static constexpr int DITHER_BLOCK = 32;
+
 private:
   void renderDebugData();
+  const Texture &selectMipLevel(const Triangle &tri, const Texture &texture) const;
+  bool projectAABB(const AABB &box, mat4x4 &worldViewProj, ProjectedBounds &bounds) const;
+  int selectMeshLod(const MeshData &data, const ProjectedBounds *bounds) const;
+  std::shared_ptr<const Texture> acquireTexture(const std::string &filename, Texture::Layout layout, TextureMetadata &meta);
+  void beginLoad();
+  void finishLoad(const std::function<void()> &queueResult);
+  void publishLoadedAssets();
+  void updateCullTree();
+  void cullOccluded();
+  void clipAgainstScreen(Triangle &tri, std::list<Triangle> &listTriangles);
+  int clipForRaster(Triangle &tri, Triangle *out);
+  void rasterizeTiled();
+  void prepareTiles(const ScreenRect &r);
+  void prepareTile(int tile);
+  void transformVertices(const GeometryJob &job);
+  void assembleTriangles(const GeometryJob &job, Vec3 &lightView, std::vector<Triangle> &out);
+  void assembleTrianglesFixed(const GeometryJob &job, Vec3 &lightView, std::vector<Triangle> &out);
+  void computeSortKeys(const std::vector<Triangle> &triangles, std::vector<uint32_t> &keys) const;
+  void joinSorted(std::vector<Triangle> &out);
+  void prepareFrame(Vec3 &camera, Vec3 &vTarget, Vec3 &vUp);
+  void buildGeometry(std::vector<Triangle> &out);
+  bool finishGeometry();
+  ScreenRect triangleBounds(const Triangle &tri) const;
 
   enum RenderMode
   {
@@ -108,41 +340,169 @@ private:
 
   float scale;
 
+  bool headless;
   bool useDither;
+  DitherMode ditherMode;
   bool useSort;
+  SortMethod sortMethod;
+  int orderingTableSize;
+  bool usePipeline;
+  bool useTiles;
+  bool useGuardBand;
+  bool useFixedPoint;
+  RasterKernel rasterKernel;
+  TextureMapping textureMapping;
+  int spanSubdivision;
+  bool useMipmaps;
+  float lodBias;
+  bool useOcclusion;
   Color fogColor;
   float fogW;
   float clipEnd;
+  float farClip; // view space z of the projection's far plane
 
-  __m128 zero;
   size_t depthBufferSize;
 
+  // RGBA like sf::Texture::update() takes it, one uint32_t per pixel with r in
+  // the low byte (see packPixel()), 64 byte aligned and rows without padding
   uint8_t *videoBuffer;
   uint8_t *videoBufferBack;
-  sf::Image screenBuffer;
-  // sf::Image screenBuffer2;
+  // Floyd-Steinberg error pushed into each row (times 16), and how many pixels
+  // of each row are done
+  std::vector<int16_t> ditherError;
+  std::unique_ptr<std::atomic<int>[]> ditherProgress;
 
   sf::Texture screenTexture;
   sf::Sprite sprite;
 
   sf::RenderWindow window;
-  sf::Uint8 *px0;
-  // sf::Uint8 *px1;
-  sf::Uint8 *clearScreenPtr;
+  sf::Uint8 *clearScreenPtr = nullptr;
 
   float *pDepthBuffer = nullptr;
+  // 16.16 w, used instead of pDepthBuffer in fixed point mode
+  std::vector<int32_t> fixedDepthBuffer;
+
+  ScreenRect screenRect;
+  // pixels the screen clipper keeps (it clips at width - 1 and height - 1),
+  // guard band triangles that skip the clipper are clamped to it too
+  ScreenRect rasterRect;
+
+  // tile binning: screen-clipped triangles and per tile indices into them, in submission order
+  ThreadPool workers;
+  int tilesX;
+  int tilesY;
+  std::vector<Triangle> vecTrianglesClipped;
+  std::vector<std::vector<uint32_t>> tileBins;
+  // frame epoch each tile's depth was last reset in, tiles tagged with the
+  // current one are drawn this frame
+  std::vector<uint64_t> tileEpoch;
+  uint64_t frameEpoch = 1;
+  bool useColorClear;
+  bool clearAllColor = false; // the clear colour changed, every tile needs it
+  bool clearPending = true;   // render() clears first: the first frame, or a headless frame kept for getFrameBuffer()
+
+  // async loading: finished loads wait in loaded* until publishLoadedAssets()
+  struct PendingTexture
+  {
+    int id;
+    std::shared_ptr<const Texture> texture;
+    TextureMetadata meta;
+    std::promise<bool> published;
+  };
+  struct PendingMesh
+  {
+    int id;
+    std::shared_ptr<const MeshData> data;
+    std::promise<bool> published;
+  };
+  std::mutex loadMutex;
+  std::condition_variable loadCv;
+  int loadsInFlight = 0;
+  std::vector<std::shared_ptr<PendingTexture>> loadedTextures;
+  std::vector<std::shared_ptr<PendingMesh>> loadedMeshes;
+  // declared after the state its tasks use, so it is joined first
+  ThreadPool loaders{LOADER_THREADS};
+
+  // One tree leaf per component with geometry (-1 without), over the world box
+  // of all its meshes. Refitted when updateWorld() reports the component changed.
+  AABBTree cullTree;
+  std::vector<int> cullLeaves;
+  std::vector<int> visibleComponents;
+
+  // meshes that passed the frustum, in draw order; occlusion culling clears 'visible'
+  struct VisibleMesh
+  {
+    Mesh mesh; // a copy, keeps the geometry alive until the frame is built
+    size_t transform;
+    const MeshData *lod;
+    bool projected; // false when the box reaches past the near plane
+    ProjectedBounds bounds;
+    bool markedOccluder; // the component is flagged as occluder
+    bool visible;
+    bool occluder;
+  };
+  std::vector<VisibleMesh> visibleMeshes;
+  OcclusionBuffer occlusionBuffer;
+  std::vector<size_t> occluders;
+  PositionStreams occluderVertices;
+  std::vector<float> occluderW;
+
+  // geometry stage: every visible vertex is transformed once into view and clip space,
+  // then triangles are assembled from indices into one list per job, joined in job order
+  std::vector<MeshTransform> meshTransforms;
+  std::vector<GeometryJob> vertexJobs;
+  std::vector<GeometryJob> geometryJobs;
+  PositionStreams viewVertices;
+  PositionStreams clipVertices;
+  std::vector<float> clipW;
+  FixedClipStreams fixedClipVertices; // only filled in fixed point mode
+  std::vector<std::vector<Triangle>> geometryBins;
+  // sort keys of geometryBins, filled by the same jobs
+  std::vector<std::vector<uint32_t>> geometryKeys;
+  std::vector<uint32_t> sortKeys;
+  std::vector<uint32_t> sortOrder;
+  std::vector<uint32_t> sortCounts;
+  std::vector<const Triangle *> sortSources;
+
+  // what buildGeometry() reads besides the visible meshes, copied by
+  // prepareFrame() so settings can change while a frame is being built
+  struct GeometrySettings
+  {
+    Vec3 lightView;
+    bool sort;
+    SortMethod sortMethod;
+    int orderingTableSize;
+    float orderingTableScale; // buckets per view space unit past the near plane
+    bool occlusion;
+    bool fixedPoint;
+  };
+  GeometrySettings geometrySettings;
+
+  // pipelined mode: the geometry thread builds into pipelineTriangles, which is
+  // swapped with vecTrianglesToRaster by the next calculateTriangles()
+  std::vector<Triangle> pipelineTriangles;
+  std::future<void> geometryInFlight;
+  uint64_t submittedFrame = 0;
+  uint64_t displayedFrame = 0;
+  uint64_t pipelineFrame = 0;
+  // declared after the state its task uses, so it is joined first
+  ThreadPool geometryThread{1};
 
   // Helper function for texturedTriangle
   static void SortVerticesByY(Vec3 &p1, Vec3 &p2, Vec3 &p3, 
                               UV &tex1, UV &tex2, UV &tex3, 
                               float &w_val1, float &w_val2, float &w_val3);
 
-  void ScanlineFillTexturedPart(int y_start, int y_end,
-                                  float x_edge1_start, const UV& uv_edge1_start, float w_edge1_start,
-                                  float x_edge2_start, const UV& uv_edge2_start, float w_edge2_start,
-                                  float dx_edge1_step, float du_edge1_step, float dv_edge1_step, float dw_edge1_step,
-                                  float dx_edge2_step, float du_edge2_step, float dv_edge2_step, float dw_edge2_step,
-                                  sf::Image &texture, const Color &base_color);
+  void ScanlineFillTexturedPart(int y_start, int y_end, float edge_y,
+                                const EdgeWalk &edge1, const EdgeWalk &edge2,
+                                const EdgeFunction edges[3], int x_first, int x_last,
+                                const Texture &texture, const Color &base_color, const ScreenRect &clip);
+  void ScanlineFillSubdividedSpan(int y, const SpanRow &span, int col_first, int col_last,
+                                  const Texture &texture, float cr, float cg, float cb);
+  inline void writeTexel(int x, int y, uint32_t texel, float w, float cr, float cg, float cb);
+  // false when the triangle's edge functions do not fit 32 bits, nothing is drawn then
+  bool HalfSpaceFillTextured(const Triangle &tri,
+                             const Texture &texture, const Color &base_color, const ScreenRect &clip);
 };
 
 #endif // __ENGINE_H__
\ No newline at end of file
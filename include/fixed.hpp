@@ -0,0 +1,143 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+/*
+  Fixed point helpers for the fixed point pipeline.
+    - 12.4 sub-pixel screen coordinates (PS1 GTE style vertex snapping)
+    - 16.16 interpolants (texel coordinates, depth)
+*/
+
+#include <cstdint>
+#include <cmath>
+#include <utility>
+
+constexpr int SUBPIXEL_SHIFT = 4;
+constexpr int SUBPIXEL_ONE = 1 << SUBPIXEL_SHIFT;
+constexpr int FIXED_SHIFT = 16;
+constexpr int32_t FIXED_ONE = 1 << FIXED_SHIFT;
+
+inline int32_t toSubpixel(float v)
+{
+  return static_cast<int32_t>(lrintf(v * SUBPIXEL_ONE));
+}
+
+inline int32_t toFixed16(float v)
+{
+  return static_cast<int32_t>(lrintf(v * FIXED_ONE));
+}
+
+// 16.16 in 64 bits, for texel coordinates of repeated UVs on large textures
+inline int64_t toFixed16Wide(float v)
+{
+  return static_cast<int64_t>(llrintf(v * FIXED_ONE));
+}
+
+// 16.16 in 64 bits, saturated to +-limit (NaN becomes 0)
+inline int64_t saturateFixed16(float v, int64_t limit)
+{
+  float f = v * FIXED_ONE;
+  if (!(f > -limit))
+    return f != f ? 0 : -limit;
+  if (!(f < limit))
+    return limit;
+  return toFixed16Wide(v);
+}
+
+// integer part of a 16.16 value, rounded toward zero like a float to int cast
+inline int32_t fixed16Trunc(int32_t v)
+{
+  return (v + ((v >> 31) & (FIXED_ONE - 1))) >> FIXED_SHIFT;
+}
+
+inline int32_t fixed16Trunc(int64_t v)
+{
+  return static_cast<int32_t>((v + ((v >> 63) & (FIXED_ONE - 1))) >> FIXED_SHIFT);
+}
+
+// first pixel whose center is at or right of / below a 12.4 coordinate
+inline int32_t subpixelCeilCenter(int32_t v)
+{
+  return (v - SUBPIXEL_ONE / 2 + SUBPIXEL_ONE - 1) >> SUBPIXEL_SHIFT;
+}
+
+// same for a 16.16 coordinate
+inline int32_t fixedCeilCenter(int64_t v)
+{
+  return static_cast<int32_t>((v - FIXED_ONE / 2 + FIXED_ONE - 1) >> FIXED_SHIFT);
+}
+
+// 24.8 edge function of a->b from 12.4 vertices, inside where it is >= 0.
+// Shared by the scanline and half-space kernels so their coverage is the same.
+struct EdgeFunction
+{
+  int32_t a, b; // change per pixel in x and y
+  int64_t c;    // value at the center of pixel (0, 0), fill rule bias included
+
+  EdgeFunction() : a(0), b(0), c(0) {}
+  EdgeFunction(int32_t ax, int32_t ay, int32_t bx, int32_t by)
+  {
+    int64_t dx = static_cast<int64_t>(bx) - ax;
+    int64_t dy = static_cast<int64_t>(by) - ay;
+    a = static_cast<int32_t>(dy * SUBPIXEL_ONE);
+    b = static_cast<int32_t>(-dx * SUBPIXEL_ONE);
+    c = (SUBPIXEL_ONE / 2 - static_cast<int64_t>(ax)) * dy - (SUBPIXEL_ONE / 2 - static_cast<int64_t>(ay)) * dx;
+
+    // left edges have the inside to their right, top edges below them
+    bool topLeft = dy > 0 || (dy == 0 && dx < 0);
+    if (!topLeft)
+      c -= 1;
+  }
+
+  inline int64_t at(int x, int y) const
+  {
+    return static_cast<int64_t>(a) * x + static_cast<int64_t>(b) * y + c;
+  }
+
+  // narrows the pixels x0 <= x < x1 of row y to the ones inside this edge
+  inline void clipSpan(int y, int &x0, int &x1) const
+  {
+    int64_t rowC = static_cast<int64_t>(b) * y + c;
+    if (a > 0)
+    {
+      // first x with a * x >= -rowC
+      int64_t n = -rowC;
+      int64_t first = n / a + (n % a > 0 ? 1 : 0);
+      if (first > x0)
+        x0 = first < x1 ? static_cast<int>(first) : x1;
+    }
+    else if (a < 0)
+    {
+      // last x with -a * x <= rowC
+      int64_t last = rowC / -a - (rowC % -a < 0 ? 1 : 0);
+      if (last + 1 < x1)
+        x1 = last + 1 > x0 ? static_cast<int>(last + 1) : x0;
+    }
+    else if (rowC < 0)
+    {
+      x1 = x0;
+    }
+  }
+};
+
+// Edge functions of a triangle snapped to 12.4, v1->v2, v2->v0 and v0->v1 after
+// winding the vertices (order) so the inside is positive. False for zero area.
+inline bool triangleEdges(const int32_t sx[3], const int32_t sy[3], EdgeFunction edges[3], int order[3])
+{
+  int64_t area = (static_cast<int64_t>(sx[2]) - sx[0]) * (sy[1] - sy[0]) -
+                 (static_cast<int64_t>(sy[2]) - sy[0]) * (sx[1] - sx[0]);
+  if (area == 0)
+    return false;
+
+  order[0] = 0;
+  order[1] = 1;
+  order[2] = 2;
+  if (area < 0)
+    std::swap(order[1], order[2]);
+
+  edges[0] = EdgeFunction(sx[order[1]], sy[order[1]], sx[order[2]], sy[order[2]]);
+  edges[1] = EdgeFunction(sx[order[2]], sy[order[2]], sx[order[0]], sy[order[0]]);
+  edges[2] = EdgeFunction(sx[order[0]], sy[order[0]], sx[order[1]], sy[order[1]]);
+  return true;
+}
+
+#endif // __FIXED_H__
@@ -0,0 +1,83 @@
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include <cmath>
+#include "utility.hpp"
+
+// Plane a*x + b*y + c*z + d = 0 with unit normal, positive on the inside
+struct Plane
+{
+  float a, b, c, d;
+
+  inline float distance(float x, float y, float z) const { return a * x + b * y + c * z + d; }
+};
+
+/*
+  View frustum in world space, taken from a view * projection matrix
+  (row vectors, clip = v * M, the layout Matrix_MultiplyVector uses).
+  Near and far are the planes clip w = nearW and clip w = farW, so they
+  match the engine's view space near clip and whatever far distance the
+  caller wants (projection far plane, fog end). The side planes are the
+  usual clip space bounds.
+
+  The planes are also kept as SoA lanes so classify() tests all of them at
+  once, the two spare lanes always pass.
+*/
+struct Frustum
+{
+  enum Side
+  {
+    outside,
+    intersecting,
+    inside,
+  };
+
+  static constexpr int LANES = 8;
+
+  Plane planes[6];
+  alignas(32) float nx[LANES];
+  alignas(32) float ny[LANES];
+  alignas(32) float nz[LANES];
+  alignas(32) float nd[LANES];
+
+  void fromMatrix(const mat4x4 &m, float nearW, float farW)
+  {
+    // w + sign * column j of the matrix
+    auto combine = [&](int j, float sign) -> Plane
+    {
+      return {m.m[0][3] + sign * m.m[0][j], m.m[1][3] + sign * m.m[1][j],
+              m.m[2][3] + sign * m.m[2][j], m.m[3][3] + sign * m.m[3][j]};
+    };
+    planes[0] = combine(0, 1.0f);  // left
+    planes[1] = combine(0, -1.0f); // right
+    planes[2] = combine(1, 1.0f);  // bottom
+    planes[3] = combine(1, -1.0f); // top
+    planes[4] = combine(2, 0.0f);  // near, w >= nearW
+    planes[4].d -= nearW;
+    planes[5] = {-m.m[0][3], -m.m[1][3], -m.m[2][3], farW - m.m[3][3]}; // far, w <= farW
+
+    for (int i = 0; i < LANES; i++)
+    {
+      Plane p = {0, 0, 0, 1e30f};
+      if (i < 6)
+      {
+        p = planes[i];
+        float len = sqrtf(p.a * p.a + p.b * p.b + p.c * p.c);
+        if (len > 0.0f)
+          p = {p.a / len, p.b / len, p.c / len, p.d / len};
+        planes[i] = p;
+      }
+      nx[i] = p.a;
+      ny[i] = p.b;
+      nz[i] = p.c;
+      nd[i] = p.d;
+    }
+  }
+
+  // The box's bounding sphere settles boxes well inside or well outside, only
+  // the rest get the exact test with the box corners nearest to and furthest
+  // along each plane normal. Allocation free.
+  Side classify(const AABB &box) const;
+};
+
+#endif // __FRUSTUM_H__
@@ -7,15 +7,85 @@
 */
 
 #include <vector>
+#include <cstdint>
+#include <memory>
 #include "utility.hpp"
+#include "vertexTransform.hpp"
 
+class AssetPack;
 
-struct Mesh
+// Read-only vertex and index data of a mesh, owned by MeshData or mapped from a pack
+struct MeshView
+{
+  const float *x = nullptr;
+  const float *y = nullptr;
+  const float *z = nullptr;
+  const UV *uvs = nullptr;
+  const uint32_t *indices = nullptr;
+  size_t vertexCount = 0;
+  size_t indexCount = 0;
+};
+
+// Mesh geometry, loaded once and shared by every Mesh using it
+struct MeshData
 {
-  std::vector<Triangle> tris;
+  // one vertex per unique position/uv pair, shared by all triangles using it.
+  // Empty when the mesh comes from a pack, see packed.
+  PositionStreams positions;
+  std::vector<UV> uvs;
+  // three indices into positions/uvs per triangle
+  std::vector<uint32_t> indices;
+  MeshView packed;
   AABB aabb;
+  // coarser versions, each about half the triangles of the one before
+  std::vector<MeshData> lods;
+
+  static constexpr int LOD_LEVELS = 4; // including this one
+
   bool LoadObjFromFile(std::string filename, bool centerModel = true);
-  int textureID;
+  // Points the mesh at cooked data, the pack has to outlive the mesh. Levels
+  // cooked as "<name>#lod1", "<name>#lod2"... are mapped into lods.
+  bool LoadFromPack(const AssetPack &pack, const std::string &name, bool centerModel = true);
+  // quadric simplification down to LOD_LEVELS levels, stops early once a level
+  // no longer gets much smaller
+  void generateLods();
+
+  int lodCount() const { return 1 + static_cast<int>(lods.size()); }
+  // clamps to the coarsest level
+  const MeshData &lod(int level) const
+  {
+    if (level <= 0 || lods.empty())
+      return *this;
+    return lods[level <= static_cast<int>(lods.size()) ? level - 1 : lods.size() - 1];
+  }
+
+  // built on every call, so copies never point at another mesh's buffers
+  MeshView view() const
+  {
+    if (packed.indices)
+      return packed;
+    return {positions.x.data(), positions.y.data(), positions.z.data(), uvs.data(), indices.data(),
+            positions.size(), indices.size()};
+  }
+  size_t vertexCount() const { return packed.indices ? packed.vertexCount : positions.size(); }
+  size_t triangleCount() const { return (packed.indices ? packed.indexCount : indices.size()) / 3; }
+  // heap memory owned by this mesh and its lods, pack data is not counted
+  size_t memoryUsed() const;
+  uint64_t contentHash() const;
+  // same vertices and indices, byte for byte
+  bool sameContent(const MeshData &other) const;
+};
+
+// One use of shared geometry, cheap to copy
+struct Mesh
+{
+  std::shared_ptr<const MeshData> data;
+  Color color = {255, 255, 255};
+  int textureID = -1;
+
+  MeshView view() const { return data ? data->view() : MeshView(); }
+  size_t vertexCount() const { return data ? data->vertexCount() : 0; }
+  size_t triangleCount() const { return data ? data->triangleCount() : 0; }
 };
 
 #endif // __MESH_H__
\ No newline at end of file
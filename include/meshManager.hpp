@@ -2,11 +2,20 @@
 #define __MESHMANAGER_H__
 
 #include <vector>
+#include <string>
 #include "mesh.hpp"
+#include "resourceCache.hpp"
 
 struct Meshes
 {
   std::vector<Mesh> meshes;
 };
 
+using MeshCache = ResourceCache<MeshData>;
+
+// Geometry of an OBJ file, taken from the cache, the pack or the file in that
+// order. pack and cache may be null. Returns null when loading fails.
+std::shared_ptr<const MeshData> LoadMeshData(const std::string &filename, bool centerModel,
+                                             const AssetPack *pack, MeshCache *cache);
+
 #endif // __MESHMANAGER_H__
\ No newline at end of file
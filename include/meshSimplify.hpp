@@ -0,0 +1,19 @@
+#ifndef __MESHSIMPLIFY_H__
+#define __MESHSIMPLIFY_H__
+
+#include <cstddef>
+#include "mesh.hpp"
+
+/*
+  Quadric error edge collapse (Garland & Heckbert). Vertices are welded by
+  position first, so uv seams never open cracks. Collapses move one position
+  onto its neighbour (no new positions are made up), and each triangle corner
+  keeps its own uv. Border vertices stay where they are, collapses that would
+  flip a triangle are skipped.
+
+  Stops at targetTriangles or when nothing can be collapsed any more. 'out'
+  gets fresh indexed data, its aabb is left to the caller.
+*/
+bool SimplifyMesh(const MeshView &in, size_t targetTriangles, MeshData &out);
+
+#endif // __MESHSIMPLIFY_H__
@@ -0,0 +1,33 @@
+#ifndef __OBJPARSER_H__
+#define __OBJPARSER_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "utility.hpp"
+
+// One triangle corner, 0-based indices into ObjData, -1 when missing or invalid
+struct ObjCorner
+{
+  int32_t v;
+  int32_t vt;
+};
+
+// Raw OBJ geometry: positions, texture coordinates and triangulated faces
+struct ObjData
+{
+  std::vector<Vec3> positions;
+  std::vector<UV> uvs;
+  std::vector<ObjCorner> corners; // three per triangle
+};
+
+/*
+  Reads 'v', 'vt' and 'f' records, everything else is skipped. The file is
+  read into memory in one go and split at line boundaries into chunks that
+  are parsed in parallel, then stitched in file order. Faces with more than
+  three corners are fan triangulated, negative indices count back from the
+  last element defined before the face.
+*/
+bool ParseObj(const std::string &filename, ObjData &out);
+
+#endif // __OBJPARSER_H__
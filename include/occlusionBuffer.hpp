@@ -0,0 +1,69 @@
+#ifndef __OCCLUSIONBUFFER_H__
+#define __OCCLUSIONBUFFER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+  Depth only software raster of a few occluders, plus min/max pyramids for
+  testing screen rectangles against it. Depth follows pDepthBuffer: 1/z,
+  bigger is nearer, 0 where nothing was drawn.
+
+  Level 0 has one texel per scale x scale screen pixels. Occluders are still
+  sampled at every screen pixel centre, and a texel only counts as covered
+  once all of its pixels are, keeping the farthest depth written to it. A
+  texel is never nearer than any of its pixels, so culling stays
+  conservative at the lower resolution, and triangles sharing an edge
+  complete each other's texels.
+
+  Each level above level 0 halves both sizes
+  and keeps the smallest (farthest) and largest (nearest) depth of its 2x2
+  texels. A rectangle is hidden when its nearest depth lies behind the
+  farthest occluder depth everywhere it covers. The test starts on a coarse
+  level and only descends into texels that can not decide it.
+*/
+class OcclusionBuffer
+{
+public:
+  static constexpr int MAX_SCALE = 4;
+
+  // Screen size in pixels, scale pixels per texel along each axis (1 to
+  // MAX_SCALE). Pixels at or past coverWidth/coverHeight are never covered by
+  // occluders, for screen edges the renderer does not draw either.
+  void resize(int screenWidth, int screenHeight, int scale, int coverWidth, int coverHeight);
+  void clear();
+
+  // Screen space triangle, x/y in screen pixels and w = 1/z per vertex. Only
+  // pixels whose centre is inside are written, like the main rasterizers' coverage.
+  void drawTriangle(const float *x, const float *y, const float *w);
+  // call after the last drawTriangle() of the frame
+  void buildPyramid();
+
+  // texels x0 <= x < x1, y0 <= y < y1, nearestW the largest 1/z of the object
+  bool isOccluded(int x0, int y0, int x1, int y1, float nearestW) const;
+
+private:
+  struct Level
+  {
+    int width;
+    int height;
+    std::vector<float> minW;
+    std::vector<float> maxW;
+  };
+
+  bool regionOccluded(int level, int tx, int ty, int x0, int y0, int x1, int y1, float nearestW) const;
+
+  std::vector<Level> levels;
+  // level 0 while drawing: which of a texel's pixels are covered (bit
+  // (py % scale) * scale + px % scale) and the farthest depth written to it
+  std::vector<uint16_t> coverage;
+  std::vector<float> coveredW;
+  int scale = 1;
+  int screenWidth = 0;
+  int screenHeight = 0;
+  int coverWidth = 0;
+  int coverHeight = 0;
+};
+
+#endif // __OCCLUSIONBUFFER_H__
@@ -0,0 +1,183 @@
+#ifndef __RESOURCECACHE_H__
+#define __RESOURCECACHE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// FNV-1a over raw bytes, chain calls through 'seed' to hash several arrays
+inline uint64_t HashBytes(const void *data, size_t bytes, uint64_t seed = 14695981039346656037ull)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint64_t h = seed;
+  for (size_t i = 0; i < bytes; i++)
+  {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/*
+  Shared, reference counted assets. Handles are shared_ptrs, so an asset is
+  "in use" while anything besides the cache holds one. Assets are found by
+  key (usually the path plus load options) and, after loading, by content,
+  so the same data under two paths is stored once. Content is looked up by
+  hash and confirmed with T::sameContent(), a hash collision alone never
+  makes two assets share storage. Assets mapped from a pack are only found
+  by key, the pack entry already identifies them and hashing would read
+  (page in) all of their data.
+
+  memoryUsed() is the sum of the sizes given to insert(). When it is above
+  the budget, trim() drops unused assets, least recently used first. A
+  budget of 0 means no limit. All calls are thread safe.
+*/
+template <typename T>
+class ResourceCache
+{
+public:
+  using Handle = std::shared_ptr<const T>;
+
+  // touches the entry, returns null when the key is unknown
+  Handle find(const std::string &key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byKey.find(key);
+    if (it == byKey.end())
+      return nullptr;
+    touch(it->second);
+    return it->second->resource;
+  }
+
+  // Adds a freshly loaded asset. If one with the same content is cached already,
+  // that one is returned instead and 'key' becomes another name for it.
+  Handle insert(const std::string &key, uint64_t contentHash, Handle resource, size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto candidates = byHash.equal_range(contentHash);
+    for (auto same = candidates.first; same != candidates.second; ++same)
+    {
+      if (!same->second->resource->sameContent(*resource))
+        continue;
+      byKey[key] = same->second;
+      same->second->keys.push_back(key);
+      touch(same->second);
+      return same->second->resource;
+    }
+
+    lru.push_front({resource, bytes, contentHash, true, {key}});
+    byKey[key] = lru.begin();
+    byHash.emplace(contentHash, lru.begin());
+    used += bytes;
+
+    trimLocked();
+    return resource;
+  }
+
+  // Adds an asset found by key only. If another thread cached the key meanwhile,
+  // that asset is returned instead.
+  Handle insert(const std::string &key, Handle resource, size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = byKey.find(key);
+    if (it != byKey.end())
+    {
+      touch(it->second);
+      return it->second->resource;
+    }
+
+    lru.push_front({resource, bytes, 0, false, {key}});
+    byKey[key] = lru.begin();
+    used += bytes;
+
+    trimLocked();
+    return resource;
+  }
+
+  void setBudget(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    trimLocked();
+  }
+
+  void trim()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    trimLocked();
+  }
+
+  size_t memoryUsed() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+  }
+
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+  }
+
+private:
+  struct Entry
+  {
+    Handle resource;
+    size_t bytes;
+    uint64_t hash;
+    bool hashed; // false for key only entries, which are not in byHash
+    std::list<std::string> keys;
+  };
+  using Iterator = typename std::list<Entry>::iterator;
+
+  void touch(Iterator it)
+  {
+    lru.splice(lru.begin(), lru, it);
+  }
+
+  void trimLocked()
+  {
+    if (budget == 0)
+      return;
+
+    for (auto it = lru.end(); used > budget && it != lru.begin();)
+    {
+      --it;
+      if (it->resource.use_count() > 1)
+        continue;
+
+      for (const std::string &key : it->keys)
+      {
+        auto k = byKey.find(key);
+        if (k != byKey.end() && k->second == it)
+          byKey.erase(k);
+      }
+      auto candidates = it->hashed ? byHash.equal_range(it->hash) : std::make_pair(byHash.end(), byHash.end());
+      for (auto h = candidates.first; h != candidates.second; ++h)
+      {
+        if (h->second == it)
+        {
+          byHash.erase(h);
+          break;
+        }
+      }
+      used -= it->bytes;
+      it = lru.erase(it);
+    }
+  }
+
+  mutable std::mutex mutex;
+  std::list<Entry> lru; // most recently used first
+  std::unordered_map<std::string, Iterator> byKey;
+  std::unordered_multimap<uint64_t, Iterator> byHash; // colliding hashes keep one entry each
+  size_t used = 0;
+  size_t budget = 0;
+};
+
+#endif // __RESOURCECACHE_H__
@@ -0,0 +1,96 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <emmintrin.h>
+
+/*
+  Engine side texture storage. Texels are packed RGBA (r in the low byte,
+  same as sf::Image) in a 64 byte aligned buffer, owned by the texture or
+  mapped from an asset pack.
+    - linear: row after row
+    - tiled: 4x4 texel blocks, one block per cache line, blocks row after row
+  Power of two sizes wrap with masks, other sizes clamp to the edge.
+  generateMips() adds the smaller levels, each a Texture of its own in the
+  same layout, so the rasterizers sample any level like level 0.
+*/
+struct Texture
+{
+  enum Layout
+  {
+    linear,
+    tiled,
+  };
+
+  struct AlignedFree
+  {
+    void operator()(uint32_t *p) const { _mm_free(p); }
+  };
+
+  int width = 0;
+  int height = 0;
+  int stride = 0; // texels per row (linear) or blocks per row (tiled)
+  int maskX = 0;
+  int maskY = 0;
+  bool pow2 = false;
+  Layout layout = linear;
+  const uint32_t *texels = nullptr;
+  std::unique_ptr<uint32_t[], AlignedFree> storage; // empty for views
+  std::vector<Texture> mips;                        // level 1 (half size) down to 1x1
+
+  static constexpr int BLOCK_SHIFT = 2;
+  static constexpr int BLOCK_SIZE = 1 << BLOCK_SHIFT;
+
+  // rgba is width * height * 4 bytes, as returned by sf::Image::getPixelsPtr()
+  void create(int w, int h, const uint8_t *rgba, Layout l = linear);
+  // uses texels already in layout l (texelCount() of them) without copying
+  void createView(int w, int h, const uint32_t *data, Layout l);
+  size_t texelCount() const;
+  // Box filters each level from the one above and quantises it like the loaders
+  // quantise level 0. Works on views too, the new levels are always owned.
+  void generateMips();
+  // bytes owned by this texture, views only count their mip levels
+  size_t memoryUsed() const;
+  // hash of level 0, size and layout, see sameContent()
+  uint64_t contentHash() const;
+  // same size, layout and level 0 texels, byte for byte
+  bool sameContent(const Texture &other) const;
+
+  int levelCount() const { return 1 + static_cast<int>(mips.size()); }
+  // clamps to the smallest level
+  const Texture &level(int l) const
+  {
+    if (l <= 0 || mips.empty())
+      return *this;
+    return mips[l <= static_cast<int>(mips.size()) ? l - 1 : mips.size() - 1];
+  }
+
+  inline int index(int x, int y) const
+  {
+    if (pow2)
+    {
+      x &= maskX;
+      y &= maskY;
+    }
+    else
+    {
+      x = x < 0 ? 0 : (x >= width ? width - 1 : x);
+      y = y < 0 ? 0 : (y >= height ? height - 1 : y);
+    }
+
+    if (layout == linear)
+      return y * stride + x;
+
+    int block = (y >> BLOCK_SHIFT) * stride + (x >> BLOCK_SHIFT);
+    return (block << (2 * BLOCK_SHIFT)) + ((y & (BLOCK_SIZE - 1)) << BLOCK_SHIFT) + (x & (BLOCK_SIZE - 1));
+  }
+
+  inline uint32_t fetch(int x, int y) const
+  {
+    return texels[index(x, y)];
+  }
+};
+
+#endif // __TEXTURE_H__
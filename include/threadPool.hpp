@@ -0,0 +1,51 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Fixed set of worker threads. parallelFor() hands out job indices one at a
+  time and blocks until every index of its batch is done, the calling thread
+  helps while it waits. Batches from different threads may run at once.
+  submit() queues a task and returns at once, workers pick tasks up when no
+  batch is waiting. Without workers the task runs inside submit(). The
+  destructor runs every task still queued before joining the workers.
+*/
+class ThreadPool
+{
+public:
+  explicit ThreadPool(unsigned numThreads = 0);
+  ~ThreadPool();
+
+  void parallelFor(size_t count, const std::function<void(size_t)> &job);
+  void submit(std::function<void()> task);
+  size_t size() const;
+
+private:
+  struct Batch
+  {
+    const std::function<void(size_t)> *job;
+    size_t count;
+    size_t next;
+    size_t done;
+  };
+
+  void workerLoop();
+  bool runOne(std::unique_lock<std::mutex> &lock, Batch *batch);
+
+  std::vector<std::thread> workers;
+  std::deque<Batch *> queue;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable workCv;
+  std::condition_variable doneCv;
+  bool stopping;
+};
+
+#endif // __THREADPOOL_H__
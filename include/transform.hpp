@@ -3,22 +3,33 @@
 
 #include "utility.hpp"
 
+// Local rotation and position of a component. Changes mark the transform dirty,
+// matWorld is only rebuilt for dirty transforms and their descendants, see
+// Components::updateWorld().
 class Transform
 {
 public:
-  Vec3 pos;
+  // angles of the last calculateAngles()
   Vec3 rot;
 
   Transform();
   ~Transform();
 
-  void setupMatrix(mat4x4 &m3);
+  const Vec3 &position() const { return pos; }
+  void setPosition(const Vec3 &p);
   void calculateAngles(float x, float y, float z);
 
+  bool isDirty() const { return dirty; }
+  void markDirty() { dirty = true; }
+  // matWorld = rotation (z, then y, then x), translation, then the parent's world matrix
+  void updateWorld(const mat4x4 *parentWorld);
+
   mat4x4 matWorld;
 
 private:
-  mat4x4 matRotZ, matRotX, matRotY;
+  Vec3 pos;
+  mat4x4 matRotation;
+  bool dirty;
 };
 
-#endif // __TRANSFORM_H__
\ No newline at end of file
+#endif // __TRANSFORM_H__
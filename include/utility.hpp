@@ -4,7 +4,6 @@
 /*
   todo:
   - precalculate sin/cos
-  - use fixed point numbers
   - triangle store normals too
 
 */
@@ -108,8 +107,15 @@ inline mat4x4 Matrix_MultiplyMatrix(mat4x4 &m1, mat4x4 &m2)
 Vec3 Matrix_MultiplyVector(mat4x4 &m, Vec3 &i);
 Vec3 Vector_IntersectPlane(Vec3 &plane_p, Vec3 &plane_n, Vec3 &lineStart, Vec3 &lineEnd, float &t);
 
+// Box around the transformed box (affine m), from the centre and the absolute rotated extents
+AABB AABB_Transform(const AABB &box, const mat4x4 &m);
+
 int Triangle_CLipAgainstPlane(Vec3 &plane_p, Vec3 &plane_n, Triangle &in_tri, Triangle &out_tri1, Triangle &out_tri2);
 
+// Clips a screen space triangle to [minX, maxX] x [minY, maxY] on the stack, no allocation.
+// The clipped polygon is written as a fan of up to 5 triangles, returns their count.
+int Triangle_ClipAgainstRect(const Triangle &in_tri, float minX, float minY, float maxX, float maxY, Triangle out_tris[5]);
+
 Vec3 Vector_Add(Vec3 &v1, Vec3 &v2);
 Vec3 Vector_Sub(Vec3 &v1, Vec3 &v2);
 Vec3 Vector_Mul(Vec3 &v1, float k);
@@ -131,6 +137,13 @@ t clamp2(t x, t min, t max)
   return x;
 }
 
+// Pixel containing a screen coordinate. Guard band coordinates can be negative,
+// where static_cast<int> would round toward zero instead of down.
+inline int floorToInt(double v)
+{
+  return static_cast<int>(std::floor(v));
+}
+
 float max(float a, float b);
 void printVector(Vec3 &v);
 Color mixRGB(uint8_t r1, uint8_t g1, uint8_t b1, uint8_t r2, uint8_t g2, uint8_t b2, float v);
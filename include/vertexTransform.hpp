@@ -0,0 +1,72 @@
+#ifndef __VERTEXTRANSFORM_H__
+#define __VERTEXTRANSFORM_H__
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "utility.hpp"
+
+// Vertex positions stored as separate x, y and z arrays so they can be
+// loaded 4 (SSE) or 8 (AVX) vertices at a time
+struct PositionStreams
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+
+  void clear()
+  {
+    x.clear();
+    y.clear();
+    z.clear();
+  }
+
+  void resize(size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  }
+
+  void push_back(const Vec3 &v)
+  {
+    x.push_back(v.x);
+    y.push_back(v.y);
+    z.push_back(v.z);
+  }
+
+  Vec3 at(size_t i) const { return {x[i], y[i], z[i], 1.0f}; }
+};
+
+// Clip space x, y and w in 16.16 for the fixed point pipeline, which has no use for z
+struct FixedClipStreams
+{
+  std::vector<int32_t> x;
+  std::vector<int32_t> y;
+  std::vector<int32_t> w;
+
+  size_t size() const { return x.size(); }
+
+  void resize(size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+    w.resize(n);
+  }
+};
+
+// Transforms 'count' points (x, y, z, 1) by m. Matches Matrix_MultiplyVector
+// for w = 1. ow may be null when the w component is not needed.
+void TransformPositions(const mat4x4 &m, const float *x, const float *y, const float *z, size_t count,
+                        float *ox, float *oy, float *oz, float *ow);
+
+// TransformPositions for the fixed point pipeline. m and the points are rounded
+// to 16.16 and multiplied in 64 bits, like the PS1's GTE, so the output only
+// depends on those rounded values. Results saturate to the 16.16 range.
+void TransformPositionsFixed(const mat4x4 &m, const float *x, const float *y, const float *z, size_t count,
+                             int32_t *ox, int32_t *oy, int32_t *ow);
+
+#endif // __VERTEXTRANSFORM_H__
@@ -0,0 +1,239 @@
+#include "aabbTree.hpp"
+#include <algorithm>
+
+namespace
+{
+  // fat boxes grow by this fraction of their size on every side, plus a minimum
+  constexpr float FAT_FRACTION = 0.1f;
+  constexpr float FAT_MINIMUM = 0.05f;
+
+  inline AABB combine(const AABB &a, const AABB &b)
+  {
+    AABB r;
+    r.min = {std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)};
+    r.max = {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)};
+    return r;
+  }
+
+  inline float area(const AABB &b)
+  {
+    float dx = b.max.x - b.min.x, dy = b.max.y - b.min.y, dz = b.max.z - b.min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+  }
+
+  inline bool contains(const AABB &outer, const AABB &inner)
+  {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+  }
+
+  inline AABB fatten(const AABB &b)
+  {
+    float mx = std::max(FAT_MINIMUM, (b.max.x - b.min.x) * FAT_FRACTION);
+    float my = std::max(FAT_MINIMUM, (b.max.y - b.min.y) * FAT_FRACTION);
+    float mz = std::max(FAT_MINIMUM, (b.max.z - b.min.z) * FAT_FRACTION);
+    AABB r;
+    r.min = {b.min.x - mx, b.min.y - my, b.min.z - mz};
+    r.max = {b.max.x + mx, b.max.y + my, b.max.z + mz};
+    return r;
+  }
+}
+
+int AABBTree::allocate()
+{
+  if (freeList < 0)
+  {
+    nodes.emplace_back();
+    return static_cast<int>(nodes.size()) - 1;
+  }
+
+  int node = freeList;
+  freeList = nodes[node].next;
+  nodes[node] = Node();
+  return node;
+}
+
+void AABBTree::release(int node)
+{
+  nodes[node].height = -1;
+  nodes[node].next = freeList;
+  freeList = node;
+}
+
+int AABBTree::insert(const AABB &box, int userData)
+{
+  int leaf = allocate();
+  nodes[leaf].box = fatten(box);
+  nodes[leaf].userData = userData;
+  insertLeaf(leaf);
+  return leaf;
+}
+
+void AABBTree::remove(int leaf)
+{
+  removeLeaf(leaf);
+  release(leaf);
+}
+
+bool AABBTree::move(int leaf, const AABB &box)
+{
+  if (contains(nodes[leaf].box, box))
+    return false;
+
+  removeLeaf(leaf);
+  nodes[leaf].box = fatten(box);
+  insertLeaf(leaf);
+  return true;
+}
+
+void AABBTree::clear()
+{
+  nodes.clear();
+  root = -1;
+  freeList = -1;
+}
+
+void AABBTree::insertLeaf(int leaf)
+{
+  if (root < 0)
+  {
+    root = leaf;
+    nodes[root].parent = -1;
+    return;
+  }
+
+  // walk down while pushing the leaf into a child is cheaper than pairing it here
+  AABB box = nodes[leaf].box;
+  int index = root;
+  while (!nodes[index].isLeaf())
+  {
+    const Node &n = nodes[index];
+    float combinedArea = area(combine(n.box, box));
+    float cost = 2.0f * combinedArea;
+    float inheritance = 2.0f * (combinedArea - area(n.box));
+
+    auto descendCost = [&](int child)
+    {
+      float grown = area(combine(box, nodes[child].box));
+      if (!nodes[child].isLeaf())
+        grown -= area(nodes[child].box);
+      return grown + inheritance;
+    };
+    float costLeft = descendCost(n.left);
+    float costRight = descendCost(n.right);
+
+    if (cost < costLeft && cost < costRight)
+      break;
+    index = costLeft < costRight ? n.left : n.right;
+  }
+
+  int sibling = index;
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocate();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = combine(box, nodes[sibling].box);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].left = sibling;
+  nodes[newParent].right = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent < 0)
+    root = newParent;
+  else if (nodes[oldParent].left == sibling)
+    nodes[oldParent].left = newParent;
+  else
+    nodes[oldParent].right = newParent;
+
+  refit(nodes[leaf].parent);
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+  if (leaf == root)
+  {
+    root = -1;
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+  if (grandParent < 0)
+  {
+    root = sibling;
+    nodes[sibling].parent = -1;
+    release(parent);
+    return;
+  }
+
+  if (nodes[grandParent].left == parent)
+    nodes[grandParent].left = sibling;
+  else
+    nodes[grandParent].right = sibling;
+  nodes[sibling].parent = grandParent;
+  release(parent);
+  refit(grandParent);
+}
+
+// rebuilds boxes and heights from 'node' up to the root, rotating where unbalanced
+void AABBTree::refit(int node)
+{
+  while (node >= 0)
+  {
+    node = balance(node);
+    Node &n = nodes[node];
+    n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+    n.box = combine(nodes[n.left].box, nodes[n.right].box);
+    node = n.parent;
+  }
+}
+
+// If one child of A is two levels deeper than the other, that child takes A's
+// place and A adopts its shallower grandchild. Returns the node now at A's place.
+int AABBTree::balance(int a)
+{
+  if (nodes[a].isLeaf() || nodes[a].height < 2)
+    return a;
+
+  int b = nodes[a].left;
+  int c = nodes[a].right;
+  int diff = nodes[c].height - nodes[b].height;
+  if (diff >= -1 && diff <= 1)
+    return a;
+
+  // 'up' replaces a, 'stay' is a's other child
+  bool rightHeavy = diff > 1;
+  int up = rightHeavy ? c : b;
+  int stay = rightHeavy ? b : c;
+  int f = nodes[up].left;
+  int g = nodes[up].right;
+
+  nodes[up].parent = nodes[a].parent;
+  nodes[a].parent = up;
+  if (nodes[up].parent < 0)
+    root = up;
+  else if (nodes[nodes[up].parent].left == a)
+    nodes[nodes[up].parent].left = up;
+  else
+    nodes[nodes[up].parent].right = up;
+
+  // the deeper grandchild stays under 'up', the other one moves to a
+  int keep = nodes[f].height > nodes[g].height ? f : g;
+  int give = keep == f ? g : f;
+
+  nodes[up].left = a;
+  nodes[up].right = keep;
+  if (rightHeavy)
+    nodes[a].right = give;
+  else
+    nodes[a].left = give;
+  nodes[give].parent = a;
+
+  nodes[a].box = combine(nodes[stay].box, nodes[give].box);
+  nodes[a].height = 1 + std::max(nodes[stay].height, nodes[give].height);
+  nodes[up].box = combine(nodes[a].box, nodes[keep].box);
+  nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+  return up;
+}
@@ -0,0 +1,313 @@
+#include "assetPack.hpp"
+#include "mesh.hpp"
+#include "texture.hpp"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <emmintrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignUp(uint64_t v)
+{
+  return (v + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+}
+
+// count elements of 'stride' bytes at an aligned offset, all inside 'size' bytes
+static bool arrayFits(uint64_t offset, uint64_t count, uint64_t stride, uint64_t size)
+{
+  return offset % PACK_ALIGN == 0 && offset <= size && count <= (size - offset) / stride;
+}
+
+// Checks an entry's header and arrays against the mapped size, so views into
+// the pack never read past it. Only headers are read, mesh indices are checked
+// when the mesh is loaded (AssetPack::indicesValid).
+static bool entryValid(const uint8_t *data, uint64_t size, const PackEntry &e)
+{
+  if (e.nameOffset > size || e.nameLength > size - e.nameOffset)
+    return false;
+
+  if (e.type == PACK_MESH)
+  {
+    if (!arrayFits(e.offset, 1, sizeof(PackMeshHeader), size))
+      return false;
+    const PackMeshHeader *h = reinterpret_cast<const PackMeshHeader *>(data + e.offset);
+    if (h->indexCount % 3 != 0 ||
+        !arrayFits(h->xOffset, h->vertexCount, sizeof(float), size) ||
+        !arrayFits(h->yOffset, h->vertexCount, sizeof(float), size) ||
+        !arrayFits(h->zOffset, h->vertexCount, sizeof(float), size) ||
+        !arrayFits(h->uvOffset, h->vertexCount, sizeof(UV), size) ||
+        !arrayFits(h->indexOffset, h->indexCount, sizeof(uint32_t), size))
+      return false;
+    return true;
+  }
+
+  if (e.type == PACK_TEXTURE)
+  {
+    if (!arrayFits(e.offset, 1, sizeof(PackTextureHeader), size))
+      return false;
+    const PackTextureHeader *h = reinterpret_cast<const PackTextureHeader *>(data + e.offset);
+    if (h->width <= 0 || h->height <= 0 || h->layout > Texture::tiled)
+      return false;
+
+    // what Texture::texelCount() will address for this size and layout
+    uint64_t expected = (uint64_t)h->width * h->height;
+    if (h->layout == Texture::tiled)
+    {
+      uint64_t blocksX = (h->width + Texture::BLOCK_SIZE - 1) / Texture::BLOCK_SIZE;
+      uint64_t blocksY = (h->height + Texture::BLOCK_SIZE - 1) / Texture::BLOCK_SIZE;
+      expected = blocksX * blocksY * Texture::BLOCK_SIZE * Texture::BLOCK_SIZE;
+    }
+    return h->texelCount == expected && arrayFits(h->texelOffset, h->texelCount, sizeof(uint32_t), size);
+  }
+
+  // unknown types are skipped
+  return true;
+}
+
+AssetPack::AssetPack() : data(nullptr), size(0) {}
+
+AssetPack::~AssetPack()
+{
+  close();
+}
+
+bool AssetPack::open(const std::string &filename)
+{
+  close();
+
+#ifdef _WIN32
+  // no mmap here, read the whole file into one aligned block instead
+  std::ifstream f(filename, std::ios::binary | std::ios::ate);
+  if (!f.is_open())
+    return false;
+  size = static_cast<size_t>(f.tellg());
+  uint8_t *buffer = static_cast<uint8_t *>(_mm_malloc(size, PACK_ALIGN));
+  if (!buffer)
+    return false;
+  f.seekg(0);
+  if (!f.read(reinterpret_cast<char *>(buffer), size))
+  {
+    _mm_free(buffer);
+    return false;
+  }
+  data = buffer;
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PackHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+
+  data = static_cast<const uint8_t *>(p);
+  size = st.st_size;
+#endif
+
+  const PackHeader *header = at<PackHeader>(0);
+  if (size < sizeof(PackHeader) || header->magic != PACK_MAGIC || header->version != PACK_VERSION ||
+      header->fileSize != size ||
+      sizeof(PackHeader) + (uint64_t)header->entryCount * sizeof(PackEntry) > size)
+  {
+    printf("Invalid or outdated asset pack: %s\n", filename.c_str());
+    close();
+    return false;
+  }
+
+  const PackEntry *table = at<PackEntry>(sizeof(PackHeader));
+  for (uint32_t i = 0; i < header->entryCount; i++)
+  {
+    const PackEntry &e = table[i];
+    if (!entryValid(data, size, e))
+    {
+      printf("Corrupt asset pack entry %u: %s\n", i, filename.c_str());
+      close();
+      return false;
+    }
+    std::string name(at<char>(e.nameOffset), e.nameLength);
+    if (e.type == PACK_MESH)
+      meshes[name] = &e;
+    else if (e.type == PACK_TEXTURE)
+      textures[name] = &e;
+  }
+
+  return true;
+}
+
+void AssetPack::close()
+{
+  if (!data)
+    return;
+
+#ifdef _WIN32
+  _mm_free(const_cast<uint8_t *>(data));
+#else
+  munmap(const_cast<uint8_t *>(data), size);
+#endif
+
+  data = nullptr;
+  size = 0;
+  meshes.clear();
+  textures.clear();
+}
+
+const PackMeshHeader *AssetPack::findMesh(const std::string &name) const
+{
+  auto it = meshes.find(name);
+  return it == meshes.end() ? nullptr : at<PackMeshHeader>(it->second->offset);
+}
+
+const PackTextureHeader *AssetPack::findTexture(const std::string &name) const
+{
+  auto it = textures.find(name);
+  return it == textures.end() ? nullptr : at<PackTextureHeader>(it->second->offset);
+}
+
+bool AssetPack::indicesValid(const PackMeshHeader &mesh) const
+{
+  const uint32_t *indices = at<uint32_t>(mesh.indexOffset);
+  for (uint32_t i = 0; i < mesh.indexCount; i++)
+    if (indices[i] >= mesh.vertexCount)
+      return false;
+  return true;
+}
+
+// Appends 'bytes' at the next aligned position of the blob and returns that offset
+static uint64_t appendAligned(std::vector<uint8_t> &blob, const void *src, size_t bytes)
+{
+  uint64_t offset = alignUp(blob.size());
+  blob.resize(offset + bytes);
+  if (bytes)
+    memcpy(&blob[offset], src, bytes);
+  return offset;
+}
+
+void AssetPackWriter::addMesh(const std::string &name, const MeshData &mesh, bool centered)
+{
+  MeshView v = mesh.view();
+
+  Item item;
+  item.type = PACK_MESH;
+  item.name = name;
+
+  PackMeshHeader h = {};
+  h.aabb = mesh.aabb;
+  h.vertexCount = static_cast<uint32_t>(v.vertexCount);
+  h.indexCount = static_cast<uint32_t>(v.indexCount);
+  h.centered = centered ? 1 : 0;
+
+  item.blob.resize(sizeof(PackMeshHeader));
+  h.xOffset = appendAligned(item.blob, v.x, v.vertexCount * sizeof(float));
+  h.yOffset = appendAligned(item.blob, v.y, v.vertexCount * sizeof(float));
+  h.zOffset = appendAligned(item.blob, v.z, v.vertexCount * sizeof(float));
+  h.uvOffset = appendAligned(item.blob, v.uvs, v.vertexCount * sizeof(UV));
+  h.indexOffset = appendAligned(item.blob, v.indices, v.indexCount * sizeof(uint32_t));
+  memcpy(item.blob.data(), &h, sizeof(h));
+
+  items.push_back(std::move(item));
+}
+
+void AssetPackWriter::addTexture(const std::string &name, const Texture &texture, bool quantized)
+{
+  Item item;
+  item.type = PACK_TEXTURE;
+  item.name = name;
+
+  PackTextureHeader h = {};
+  h.width = texture.width;
+  h.height = texture.height;
+  h.layout = texture.layout;
+  h.quantized = quantized ? 1 : 0;
+  h.texelCount = texture.texelCount();
+
+  item.blob.resize(sizeof(PackTextureHeader));
+  h.texelOffset = appendAligned(item.blob, texture.texels, h.texelCount * sizeof(uint32_t));
+  memcpy(item.blob.data(), &h, sizeof(h));
+
+  items.push_back(std::move(item));
+}
+
+bool AssetPackWriter::write(const std::string &filename) const
+{
+  std::vector<PackEntry> table(items.size());
+
+  // names follow the entry table, item blobs start at aligned offsets after them
+  uint64_t offset = sizeof(PackHeader) + table.size() * sizeof(PackEntry);
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    table[i].type = items[i].type;
+    table[i].nameLength = static_cast<uint32_t>(items[i].name.size());
+    table[i].nameOffset = offset;
+    offset += items[i].name.size();
+  }
+
+  std::vector<uint64_t> blobOffsets(items.size());
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    offset = alignUp(offset);
+    blobOffsets[i] = offset;
+    table[i].offset = offset;
+    offset += items[i].blob.size();
+  }
+
+  PackHeader header = {};
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.entryCount = static_cast<uint32_t>(items.size());
+  header.fileSize = offset;
+
+  std::vector<uint8_t> file(offset, 0);
+  memcpy(&file[0], &header, sizeof(header));
+  if (!table.empty())
+    memcpy(&file[sizeof(PackHeader)], table.data(), table.size() * sizeof(PackEntry));
+
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    memcpy(&file[table[i].nameOffset], items[i].name.data(), items[i].name.size());
+
+    uint8_t *dst = &file[blobOffsets[i]];
+    memcpy(dst, items[i].blob.data(), items[i].blob.size());
+
+    // blob offsets become file offsets
+    uint64_t base = blobOffsets[i];
+    if (items[i].type == PACK_MESH)
+    {
+      PackMeshHeader h;
+      memcpy(&h, dst, sizeof(h));
+      h.xOffset += base;
+      h.yOffset += base;
+      h.zOffset += base;
+      h.uvOffset += base;
+      h.indexOffset += base;
+      memcpy(dst, &h, sizeof(h));
+    }
+    else
+    {
+      PackTextureHeader h;
+      memcpy(&h, dst, sizeof(h));
+      h.texelOffset += base;
+      memcpy(dst, &h, sizeof(h));
+    }
+  }
+
+  std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+  if (!f.is_open())
+    return false;
+  f.write(reinterpret_cast<const char *>(file.data()), file.size());
+  return f.good();
+}
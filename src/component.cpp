@@ -2,18 +2,18 @@
 
 Component::Component()
 {
-  transform.pos = {0, 0, 0};
-  transform.rot = {0, 0, 0};
 }
 
 Component::~Component()
 {
 }
 
-bool Component::createMeshFromFile(std::string filename, int textureID, bool centerMesh)
+bool Component::createMeshFromFile(std::string filename, int textureID, bool centerMesh,
+                                   const AssetPack *pack, MeshCache *cache)
 {
   Mesh m;
   meshes.meshes.push_back(m);
   meshes.meshes[0].textureID = textureID;
-  return meshes.meshes[0].LoadObjFromFile(filename, centerMesh);
+  meshes.meshes[0].data = LoadMeshData(filename, centerMesh, pack, cache);
+  return meshes.meshes[0].data != nullptr;
 }
\ No newline at end of file
@@ -1,13 +1,14 @@
 #include "componentManager.hpp"
 #include <iostream>
+#include <algorithm>
 
 bool Components::createFromFile(std::string filename, int textureID, Vec3 pos, bool centerComponent)
 {
   Component c;
-  c.transform.pos = pos;
+  c.transform.setPosition(pos);
   components.push_back(c);
   
-  if (!components.back().createMeshFromFile(filename, textureID, centerComponent))
+  if (!components.back().createMeshFromFile(filename, textureID, centerComponent, pack, meshCache))
   {
     // std::cerr << "Error: Failed to load mesh from file '" << filename << "'" << std::endl;
     components.pop_back(); // Remove the failed component
@@ -30,4 +31,96 @@ Component& Components::getOrCreate(uint32_t ID)
         //           << ". Consider pre-allocating or sequential ID usage." << std::endl;
         return components[ID];
     }
-}
\ No newline at end of file
+}
+
+bool Components::setParent(int child, int parent)
+{
+  int count = static_cast<int>(components.size());
+  if (child < 0 || child >= count || parent < -1 || parent >= count)
+    return false;
+
+  for (int p = parent; p >= 0; p = components[p].parent)
+  {
+    if (p == child)
+      return false;
+  }
+
+  components[child].parent = parent;
+  components[child].transform.markDirty();
+  hierarchyChanged = true;
+  return true;
+}
+
+void Components::sortHierarchy()
+{
+  size_t count = components.size();
+  std::vector<int> firstChild(count, -1), nextSibling(count, -1);
+  updateOrder.clear();
+
+  for (int i = static_cast<int>(count) - 1; i >= 0; i--)
+  {
+    int p = components[i].parent;
+    if (p < 0 || p >= static_cast<int>(count))
+    {
+      components[i].parent = -1;
+      updateOrder.push_back(i);
+      continue;
+    }
+    nextSibling[i] = firstChild[p];
+    firstChild[p] = i;
+  }
+  std::reverse(updateOrder.begin(), updateOrder.end());
+
+  // breadth first from the roots, so every parent comes before its children
+  for (size_t n = 0; n < updateOrder.size(); n++)
+  {
+    for (int c = firstChild[updateOrder[n]]; c >= 0; c = nextSibling[c])
+      updateOrder.push_back(c);
+  }
+  hierarchyChanged = false;
+}
+
+void Components::updateWorld()
+{
+  if (hierarchyChanged || updateOrder.size() != components.size())
+    sortHierarchy();
+
+  for (int i : updateOrder)
+  {
+    Component &c = components[i];
+    std::vector<Mesh> &meshes = c.meshes.meshes;
+
+    bool parentChanged = c.parent >= 0 && components[c.parent].worldChanged;
+    bool moved = c.transform.isDirty() || parentChanged;
+    bool meshesChanged = c.boundMeshes.size() != meshes.size();
+    for (size_t m = 0; !meshesChanged && m < meshes.size(); m++)
+      meshesChanged = c.boundMeshes[m] != meshes[m].data.get();
+
+    c.worldChanged = moved || meshesChanged;
+    if (!c.worldChanged)
+      continue;
+
+    if (moved)
+      c.transform.updateWorld(c.parent >= 0 ? &components[c.parent].transform.matWorld : nullptr);
+
+    c.boundMeshes.clear();
+    c.meshWorldBoxes.resize(meshes.size());
+    c.hasBounds = false;
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+      c.boundMeshes.push_back(meshes[m].data.get());
+      if (meshes[m].triangleCount() == 0)
+        continue;
+
+      AABB b = AABB_Transform(meshes[m].data->aabb, c.transform.matWorld);
+      c.meshWorldBoxes[m] = b;
+      if (c.hasBounds)
+      {
+        b.min = {std::min(b.min.x, c.worldBox.min.x), std::min(b.min.y, c.worldBox.min.y), std::min(b.min.z, c.worldBox.min.z)};
+        b.max = {std::max(b.max.x, c.worldBox.max.x), std::max(b.max.y, c.worldBox.max.y), std::max(b.max.z, c.worldBox.max.z)};
+      }
+      c.worldBox = b;
+      c.hasBounds = true;
+    }
+  }
+}
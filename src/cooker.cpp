@@ -0,0 +1,110 @@
+#include <SFML/Graphics.hpp>
+#include <cstdio>
+#include <string>
+#include "assetPack.hpp"
+#include "mesh.hpp"
+#include "texture.hpp"
+
+/*
+  Offline asset cooker, builds the pack the engine maps with Engine::LoadPack().
+
+    ps1_cooker out.pack [--tiled] [--no-center] files...
+
+  .obj files become meshes, their lods go next to them as "<path>#lod1"...
+  Everything else is loaded with sf::Image and stored quantised like
+  Engine::LoadTexture() does, its mips next to it as "<path>#mip1"... Entries are named by the path given here,
+  which is the path the game later passes to the loaders.
+*/
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    printf("usage: ps1_cooker out.pack [--tiled] [--no-center] files...\n");
+    return 1;
+  }
+
+  Texture::Layout layout = Texture::linear;
+  bool center = true;
+  AssetPackWriter writer;
+  int cooked = 0;
+
+  for (int i = 2; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--tiled")
+    {
+      layout = Texture::tiled;
+      continue;
+    }
+    if (arg == "--no-center")
+    {
+      center = false;
+      continue;
+    }
+
+    if (endsWith(arg, ".obj"))
+    {
+      MeshData mesh;
+      if (!mesh.LoadObjFromFile(arg, center))
+      {
+        printf("Failed to load mesh: %s\n", arg.c_str());
+        return 1;
+      }
+      mesh.generateLods();
+      writer.addMesh(arg, mesh, center);
+      printf("mesh    %s: %zu vertices, %zu triangles\n", arg.c_str(), mesh.vertexCount(), mesh.triangleCount());
+      for (int level = 1; level < mesh.lodCount(); level++)
+      {
+        const MeshData &lod = mesh.lod(level);
+        writer.addMesh(arg + "#lod" + std::to_string(level), lod, center);
+        printf("  lod %d: %zu vertices, %zu triangles\n", level, lod.vertexCount(), lod.triangleCount());
+      }
+    }
+    else
+    {
+      sf::Image img;
+      if (!img.loadFromFile(arg))
+      {
+        printf("Failed to load texture: %s\n", arg.c_str());
+        return 1;
+      }
+
+      // same quantisation as Engine::QuantizeImage()
+      for (unsigned int y = 0; y < img.getSize().y; y++)
+      {
+        for (unsigned int x = 0; x < img.getSize().x; x++)
+        {
+          sf::Color pixel = img.getPixel(x, y);
+          Color color = {pixel.r, pixel.g, pixel.b};
+          Color quantized = quantise(color);
+          img.setPixel(x, y, sf::Color(quantized.r, quantized.g, quantized.b, pixel.a));
+        }
+      }
+
+      Texture texture;
+      texture.create(img.getSize().x, img.getSize().y, img.getPixelsPtr(), layout);
+      texture.generateMips();
+      writer.addTexture(arg, texture, true);
+      printf("texture %s: %dx%d, %d levels\n", arg.c_str(), texture.width, texture.height, texture.levelCount());
+      for (int level = 1; level < texture.levelCount(); level++)
+        writer.addTexture(arg + "#mip" + std::to_string(level), texture.level(level), true);
+    }
+    cooked++;
+  }
+
+  if (!writer.write(argv[1]))
+  {
+    printf("Failed to write pack: %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%d assets written to %s\n", cooked, argv[1]);
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include "engine.hpp"
+#include <immintrin.h>
+#include <thread>
+
+/*
+  Dithering of the finished frame from videoBuffer into videoBufferBack.
+
+  Both modes reduce every channel to 5 bits like the PS1's 15-bit frame
+  buffer and widen it again for display by repeating the top bits.
+
+  Ordered: the PS1 GPU's 4x4 offsets are added with saturation before the
+  low 3 bits are dropped. Pixels are independent, so row bands run on the
+  worker pool and each row is processed 16 pixels (four SSE registers of
+  RGBA bytes) at a time.
+
+  Floyd-Steinberg: each row waits for the row above to be done up to one
+  pixel past the block it is about to dither, the last error that block
+  needs. Rows therefore run in parallel as a diagonal wavefront.
+*/
+
+namespace
+{
+  // PS1 GPU dither matrix, indexed [y & 3][x & 3]
+  constexpr int BAYER[4][4] = {
+      {-4, 0, -3, 1},
+      {2, -2, 3, -1},
+      {-3, 1, -4, 0},
+      {3, -1, 2, -2},
+  };
+
+  inline uint8_t widen5(int q)
+  {
+    return static_cast<uint8_t>((q << 3) | (q >> 2));
+  }
+
+  // saturating offsets per row phase for 4 RGBA pixels starting at x % 4 == 0,
+  // alpha is left alone
+  struct OrderedTables
+  {
+    alignas(16) uint8_t add[4][16];
+    alignas(16) uint8_t sub[4][16];
+
+    OrderedTables()
+    {
+      for (int row = 0; row < 4; row++)
+      {
+        for (int i = 0; i < 16; i++)
+        {
+          int d = i % 4 == 3 ? 0 : BAYER[row][i / 4];
+          add[row][i] = static_cast<uint8_t>(d > 0 ? d : 0);
+          sub[row][i] = static_cast<uint8_t>(d < 0 ? -d : 0);
+        }
+      }
+    }
+  };
+
+  const OrderedTables orderedTables;
+
+  // nearest of the 32 widened levels for each 8-bit value
+  struct NearestLevels
+  {
+    uint8_t level[256];
+
+    NearestLevels()
+    {
+      for (int v = 0; v < 256; v++)
+        level[v] = widen5((v * 31 + 127) / 255);
+    }
+  };
+
+  const NearestLevels nearestLevels;
+
+  void ditherOrderedRow(const uint8_t *src, uint8_t *dst, int width, int y)
+  {
+    int row = y & 3;
+    int x = 0;
+
+    const __m128i add = _mm_load_si128(reinterpret_cast<const __m128i *>(orderedTables.add[row]));
+    const __m128i sub = _mm_load_si128(reinterpret_cast<const __m128i *>(orderedTables.sub[row]));
+    const __m128i high5 = _mm_set1_epi8(static_cast<char>(0xF8));
+    const __m128i low3 = _mm_set1_epi8(0x07);
+    for (; x + 16 <= width; x += 16)
+    {
+      for (int r = 0; r < 4; r++)
+      {
+        int offset = (x + r * 4) * 4;
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + offset));
+        v = _mm_subs_epu8(_mm_adds_epu8(v, add), sub);
+        v = _mm_and_si128(v, high5);
+        v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi16(v, 5), low3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + offset), v);
+      }
+    }
+
+    for (; x < width; x++)
+    {
+      int d = BAYER[row][x & 3];
+      for (int c = 0; c < 3; c++)
+      {
+        int v = std::clamp(src[x * 4 + c] + d, 0, 255);
+        dst[x * 4 + c] = widen5(v >> 3);
+      }
+      dst[x * 4 + 3] = src[x * 4 + 3];
+    }
+  }
+}
+
+void Engine::Dither_Ordered()
+{
+  int bands = (height + DITHER_ROWS - 1) / DITHER_ROWS;
+  workers.parallelFor(bands, [this](size_t band)
+                      {
+    int first = static_cast<int>(band) * DITHER_ROWS;
+    int last = std::min(first + DITHER_ROWS, height);
+    for (int y = first; y < last; y++)
+    {
+      size_t offset = static_cast<size_t>(y) * width * 4;
+      ditherOrderedRow(videoBuffer + offset, videoBufferBack + offset, width, y);
+    } });
+}
+
+void Engine::Dither_FloydSteinberg()
+{
+  // ditherError row y collects the error pushed down from row y - 1, times 16
+  std::fill(ditherError.begin(), ditherError.begin() + width * 3, 0);
+  for (int y = 0; y < height; y++)
+    ditherProgress[y].store(0, std::memory_order_relaxed);
+
+  workers.parallelFor(height, [this](size_t row)
+                      {
+    int y = static_cast<int>(row);
+    int w = width;
+    const uint8_t *src = videoBuffer + static_cast<size_t>(y) * w * 4;
+    uint8_t *dst = videoBufferBack + static_cast<size_t>(y) * w * 4;
+    const int16_t *cur = &ditherError[static_cast<size_t>(y) * w * 3];
+    int16_t *next = y + 1 < height ? &ditherError[static_cast<size_t>(y + 1) * w * 3] : nullptr;
+
+    // nothing reads the next row before this one reports progress
+    if (next)
+      std::fill(next, next + w * 3, 0);
+
+    int carry[3] = {0, 0, 0};
+    for (int x0 = 0; x0 < w; x0 += DITHER_BLOCK)
+    {
+      int x1 = std::min(x0 + DITHER_BLOCK, w);
+      if (y > 0)
+      {
+        int needed = std::min(x1 + 1, w);
+        while (ditherProgress[y - 1].load(std::memory_order_acquire) < needed)
+          std::this_thread::yield();
+      }
+
+      for (int x = x0; x < x1; x++)
+      {
+        for (int c = 0; c < 3; c++)
+        {
+          int i = x * 3 + c;
+          int v = std::clamp(src[x * 4 + c] + ((cur[i] + carry[c] + 8) >> 4), 0, 255);
+          uint8_t out = nearestLevels.level[v];
+          dst[x * 4 + c] = out;
+
+          int error = v - out;
+          carry[c] = error * 7;
+          if (!next)
+            continue;
+          if (x > 0)
+            next[i - 3] += error * 3;
+          next[i] += error * 5;
+          if (x + 1 < w)
+            next[i + 3] += error;
+        }
+        dst[x * 4 + 3] = src[x * 4 + 3];
+      }
+
+      ditherProgress[y].store(x1, std::memory_order_release);
+    } });
+}
@@ -1,7 +1,7 @@
 #include "engine.hpp"
 #include <iostream>
 
-Engine::Engine(int targetFPS, float scale, const char *title)
+Engine::Engine(int targetFPS, float scale, const char *title, bool headless)
 {
   width = 256;
   height = 224;
@@ -10,83 +10,102 @@ Engine::Engine(int targetFPS, float scale, const char *title)
   fogW = 20;
   clipEnd = 0.0f;
 
+  components.meshCache = &meshCache;
+
   fpsCounter = 0;
   fpsCounterMax = 10;
   fpsLimit = targetFPS;
   this->scale = scale;
+  this->headless = headless;
   setDither(false);
+  setDitherMode(DitherMode::ordered);
   setSort(false);
+  setSortMethod(SortMethod::orderingTable);
+  setPipelined(false);
+  setTiledRaster(false);
+  setGuardBand(false);
+  setFixedPoint(false);
+  setRasterKernel(RasterKernel::scanline);
+  setTextureMapping(TextureMapping::exact);
+  setMipmapping(true);
+  setLodBias(0.0f);
+  setOcclusionCulling(false);
+  setColorClear(true);
   generate_sincos_lookupTables();
 
-  window.create(sf::VideoMode(width * scale, height * scale), title, sf::Style::Default);
-  window.setFramerateLimit(fpsLimit);
-
-  screenBuffer.create(width, height, sf::Color::Black);
-
-  for (int y = 0; y < height; y++)
+  // headless engines render only into videoBuffer, no window or GPU texture is created
+  if (!headless)
   {
-    for (int x = 0; x < width; x++)
-    {
-      screenBuffer.setPixel(x, y, sf::Color::Black);
-    }
+    window.create(sf::VideoMode(width * scale, height * scale), title, sf::Style::Default);
+    window.setFramerateLimit(fpsLimit);
   }
 
   pDepthBuffer = new float[width * height];
   if (!pDepthBuffer) {
     throw std::runtime_error("Failed to allocate depth buffer");
   }
+  fixedDepthBuffer.resize((size_t)width * height);
 
-  videoBuffer = new uint8_t[width * height * 3];
+  size_t frameBytes = (size_t)width * height * 4;
+  videoBuffer = static_cast<uint8_t *>(_mm_malloc(frameBytes, 64));
   if (!videoBuffer) {
     delete[] pDepthBuffer;
     throw std::runtime_error("Failed to allocate video buffer");
   }
 
-  videoBufferBack = new uint8_t[width * height * 3];
+  videoBufferBack = static_cast<uint8_t *>(_mm_malloc(frameBytes, 64));
   if (!videoBufferBack) {
     delete[] pDepthBuffer;
-    delete[] videoBuffer;
+    _mm_free(videoBuffer);
     throw std::runtime_error("Failed to allocate video back buffer");
   }
 
-  screenTexture.create(width, height);
-  screenTexture.update(screenBuffer);
-  sprite.setTexture(screenTexture);
-  sprite.setScale(scale, scale);
-
-  dt = getClock();
-
-  px0 = const_cast<sf::Uint8 *>(screenBuffer.getPixelsPtr());
-
-  clearScreenPtr = new uint8_t[width * height * 3];
+  clearScreenPtr = static_cast<uint8_t *>(_mm_malloc(frameBytes, 64));
   if (!clearScreenPtr) {
     delete[] pDepthBuffer;
-    delete[] videoBuffer;
-    delete[] videoBufferBack;
+    _mm_free(videoBuffer);
+    _mm_free(videoBufferBack);
     throw std::runtime_error("Failed to allocate clear screen buffer");
   }
+  setFogColor(fogColor);
+  memcpy(videoBuffer, clearScreenPtr, frameBytes);
+  memcpy(videoBufferBack, clearScreenPtr, frameBytes);
 
-  for (int y = 0; y < height; y++)
+  if (!headless)
   {
-    for (int x = 0; x < width; x++)
-    {
-      int i = (y * width + x) * 3;
-      clearScreenPtr[i] = fogColor.r;
-      clearScreenPtr[i + 1] = fogColor.g;
-      clearScreenPtr[i + 2] = fogColor.b;
-    }
+    screenTexture.create(width, height);
+    screenTexture.update(videoBuffer);
+    sprite.setTexture(screenTexture);
+    sprite.setScale(scale, scale);
   }
 
+  deltaTime = 0;
+  dt = getClock();
+
   float fNear = 0.01f;
   float fFar = 100.0f;
+  farClip = fFar;
   float fFov = 45.0f;
   float fAspectRatio = (float)height / (float)width;
 
   matProj = Matrix_MakeProjection(fFov, fAspectRatio, fNear, fFar);
   rMode = RenderMode::textured;
 
-  zero = _mm_setzero_ps();
   depthBufferSize = width * height;
+
+  screenRect = {0, 0, width, height};
+  rasterRect = {0, 0, width - 1, height - 1};
+  tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  tileBins.resize(tilesX * tilesY);
+  tileEpoch.assign(tilesX * tilesY, 0);
+  // triangles are screen clipped (or with the guard band, clamped) at width - 1
+  // and height - 1, so the last column and row are never drawn by occluders
+  // reaching past them
+  occlusionBuffer.resize(width, height, OCCLUSION_SCALE, width - 1, height - 1);
+
+  ditherError.resize((size_t)width * height * 3);
+  ditherProgress.reset(new std::atomic<int>[height]);
 }
 
 void Engine::QuantizeImage(sf::Image &img)
@@ -104,94 +123,323 @@ void Engine::QuantizeImage(sf::Image &img)
     }
 }
 
-int Engine::LoadTexture(std::string filename)
+bool Engine::LoadPack(const std::string &filename)
 {
-  sf::Image img;
-  if (!img.loadFromFile(filename))
+  // the loader threads read pack, so it is only remapped with no load in flight
+  // and the lock held keeps new loads from starting meanwhile
+  std::unique_lock<std::mutex> lock(loadMutex);
+  loadCv.wait(lock, [this]
+              { return loadsInFlight == 0; });
+
+  if (!pack.open(filename))
   {
-    printf("Failed to load texture: %s\n", filename.c_str());
-    return -1;
+    printf("Failed to load asset pack: %s\n", filename.c_str());
+    return false;
   }
 
-  QuantizeImage(img);
+  components.pack = &pack;
+  return true;
+}
 
-  TextureMetadata meta;
-  meta.width = img.getSize().x;
-  meta.height = img.getSize().y;
-  meta.size = img.getSize().x * img.getSize().y * 4;
+// Maps the "<name>#mip1"... levels the cooker stores next to a pack texture.
+// Fails, leaving no mips, when the pack lacks the full chain down to 1x1.
+static bool mapPackMips(const AssetPack &pack, const std::string &filename, Texture &texture)
+{
+  const Texture *src = &texture;
+  for (int level = 1; src->width > 1 || src->height > 1; level++)
+  {
+    const PackTextureHeader *cooked = pack.findTexture(filename + "#mip" + std::to_string(level));
+    if (!cooked || cooked->layout != (uint32_t)texture.layout ||
+        cooked->width != std::max(1, src->width / 2) || cooked->height != std::max(1, src->height / 2))
+    {
+      texture.mips.clear();
+      return false;
+    }
+
+    texture.mips.emplace_back();
+    texture.mips.back().createView(cooked->width, cooked->height, pack.at<uint32_t>(cooked->texelOffset), texture.layout);
+    src = &texture.mips.back();
+  }
+  return true;
+}
+
+// Finds the texture in the cache, or decodes it (or maps it from the pack)
+// and caches it. Only reads engine state, so the loader threads call it too.
+std::shared_ptr<const Texture> Engine::acquireTexture(const std::string &filename, Texture::Layout layout, TextureMetadata &meta)
+{
+  std::string key = filename + (layout == Texture::tiled ? "|tiled" : "|linear");
+  std::shared_ptr<const Texture> texture = textureCache.find(key);
+  bool quantized = true;
+
+  if (!texture)
+  {
+    auto loaded = std::make_shared<Texture>();
+
+    const PackTextureHeader *cooked = pack.isOpen() ? pack.findTexture(filename) : nullptr;
+    bool fromPack = cooked && cooked->layout == (uint32_t)layout;
+    if (fromPack)
+    {
+      loaded->createView(cooked->width, cooked->height, pack.at<uint32_t>(cooked->texelOffset), layout);
+      quantized = cooked->quantized != 0;
+      // packs cooked without mips get them built like decoded images
+      if (!mapPackMips(pack, filename, *loaded))
+        loaded->generateMips();
+    }
+    else
+    {
+      sf::Image img;
+      if (!img.loadFromFile(filename))
+      {
+        printf("Failed to load texture: %s\n", filename.c_str());
+        return nullptr;
+      }
+
+      QuantizeImage(img);
+      loaded->create(img.getSize().x, img.getSize().y, img.getPixelsPtr(), layout);
+      loaded->generateMips();
+    }
+
+    // pack entries are unique by name, only decoded images are matched by content
+    if (fromPack)
+      texture = textureCache.insert(key, loaded, loaded->memoryUsed());
+    else
+      texture = textureCache.insert(key, loaded->contentHash(), loaded, loaded->memoryUsed());
+  }
+
+  meta.width = texture->width;
+  meta.height = texture->height;
+  meta.size = (size_t)texture->width * texture->height * 4;
   meta.isDithered = false;
-  meta.isQuantized = true;
+  meta.isQuantized = quantized;
   meta.filename = filename;
+  return texture;
+}
+
+int Engine::LoadTexture(std::string filename, Texture::Layout layout)
+{
+  TextureMetadata meta;
+  std::shared_ptr<const Texture> texture = acquireTexture(filename, layout, meta);
+  if (!texture)
+    return -1;
 
-  textureImage.push_back(img);
+  textures.push_back(texture);
   textureMetadata.push_back(meta);
 
-  return textureImage.size() - 1;
+  return textures.size() - 1;
+}
+
+void Engine::releaseTexture(int textureID)
+{
+  if (textureID >= 0 && (size_t)textureID < textures.size())
+    textures[textureID].reset();
+}
+
+void Engine::setResourceBudget(size_t meshBytes, size_t textureBytes)
+{
+  meshCache.setBudget(meshBytes);
+  textureCache.setBudget(textureBytes);
+}
+
+AssetRequest Engine::LoadTextureAsync(const std::string &filename, Texture::Layout layout)
+{
+  // reserve the slot now, it stays empty (and untextured) until publishLoadedAssets()
+  auto pending = std::make_shared<PendingTexture>();
+  pending->id = textures.size();
+  textures.emplace_back();
+  textureMetadata.emplace_back();
+  textureMetadata.back().filename = filename;
+
+  AssetRequest request = {pending->id, pending->published.get_future().share()};
+
+  beginLoad();
+  loaders.submit([this, pending, filename, layout]
+                 {
+                   pending->texture = acquireTexture(filename, layout, pending->meta);
+                   finishLoad([this, pending] { loadedTextures.push_back(pending); }); });
+
+  return request;
+}
+
+AssetRequest Engine::LoadComponentAsync(const std::string &filename, int textureID, Vec3 pos, bool centerComponent)
+{
+  // the component exists right away with an empty mesh, which calculateTriangles() skips
+  Component c;
+  c.transform.setPosition(pos);
+  c.meshes.meshes.emplace_back();
+  c.meshes.meshes[0].textureID = textureID;
+  components.components.push_back(c);
+
+  auto pending = std::make_shared<PendingMesh>();
+  pending->id = components.components.size() - 1;
+
+  AssetRequest request = {pending->id, pending->published.get_future().share()};
+
+  beginLoad();
+  loaders.submit([this, pending, filename, centerComponent]
+                 {
+                   pending->data = LoadMeshData(filename, centerComponent, pack.isOpen() ? &pack : nullptr, &meshCache);
+                   finishLoad([this, pending] { loadedMeshes.push_back(pending); }); });
+
+  return request;
+}
+
+void Engine::beginLoad()
+{
+  std::lock_guard<std::mutex> lock(loadMutex);
+  loadsInFlight++;
+}
+
+void Engine::finishLoad(const std::function<void()> &queueResult)
+{
+  {
+    std::lock_guard<std::mutex> lock(loadMutex);
+    queueResult();
+    loadsInFlight--;
+  }
+  loadCv.notify_all();
+}
+
+// Moves finished loads into textures/components. Runs on the render thread
+// between frames (from calculateTriangles()), so nothing is drawing from them.
+void Engine::publishLoadedAssets()
+{
+  std::vector<std::shared_ptr<PendingTexture>> doneTextures;
+  std::vector<std::shared_ptr<PendingMesh>> doneMeshes;
+  {
+    std::lock_guard<std::mutex> lock(loadMutex);
+    doneTextures.swap(loadedTextures);
+    doneMeshes.swap(loadedMeshes);
+  }
+
+  for (auto &p : doneTextures)
+  {
+    if (p->texture)
+    {
+      textures[p->id] = p->texture;
+      textureMetadata[p->id] = p->meta;
+    }
+    p->published.set_value(p->texture != nullptr);
+  }
+
+  for (auto &p : doneMeshes)
+  {
+    if (p->data && (size_t)p->id < components.components.size())
+      components.components[p->id].meshes.meshes[0].data = p->data;
+    p->published.set_value(p->data != nullptr);
+  }
+
+  // a good moment to drop assets that went unused
+  if (!doneTextures.empty() || !doneMeshes.empty())
+  {
+    meshCache.trim();
+    textureCache.trim();
+  }
+}
+
+void Engine::waitForLoads()
+{
+  {
+    std::unique_lock<std::mutex> lock(loadMutex);
+    loadCv.wait(lock, [this]
+                { return loadsInFlight == 0; });
+  }
+  publishLoadedAssets();
 }
 
 Engine::~Engine()
 {
-  if (videoBuffer != nullptr)
-    delete videoBuffer;
+  try {
+    finishGeometry();
+  } catch (const std::exception &e) {
+  }
+
+  _mm_free(videoBuffer);
   videoBuffer = nullptr;
 
-  if (videoBufferBack != nullptr)
-    delete videoBufferBack;
+  _mm_free(videoBufferBack);
   videoBufferBack = nullptr;
 
+  _mm_free(clearScreenPtr);
+  clearScreenPtr = nullptr;
+
   if (pDepthBuffer != nullptr)
-    delete pDepthBuffer;
+    delete[] pDepthBuffer;
   pDepthBuffer = nullptr;
 }
 
-void Engine::ClearDepthBufferWithSIMD(float *pDepthBuffer, size_t size)
+void Engine::clear()
 {
-  if (size % 4 != 0)
+  // videoBufferBack needs nothing, dithering overwrites all of it
+  if (useColorClear)
   {
-    for (size_t i = size - (size % 4); i < size; ++i)
+    for (int tile = 0; tile < tilesX * tilesY; tile++)
     {
-      pDepthBuffer[i] = 0.0f;
+      if (!clearAllColor && tileEpoch[tile] != frameEpoch)
+        continue;
+
+      int x0 = (tile % tilesX) * TILE_SIZE;
+      int y0 = (tile / tilesX) * TILE_SIZE;
+      size_t bytes = (size_t)(std::min(x0 + TILE_SIZE, width) - x0) * 4;
+      for (int y = y0; y < std::min(y0 + TILE_SIZE, height); y++)
+      {
+        size_t offset = ((size_t)y * width + x0) * 4;
+        memcpy(videoBuffer + offset, clearScreenPtr + offset, bytes);
+      }
     }
+    clearAllColor = false;
   }
 
-  for (size_t i = 0; i < size / 4; ++i)
-  {
-    _mm_store_ps(&pDepthBuffer[i * 4], zero);
-  }
+  // every tile's depth is now stale
+  frameEpoch++;
+  clearPending = false;
 }
 
-void Engine::clear()
+// Resets the depth of the tiles under r that were not drawn yet this frame.
+void Engine::prepareTiles(const ScreenRect &r)
+{
+  if (r.x0 >= r.x1 || r.y0 >= r.y1)
+    return;
+
+  for (int ty = r.y0 / TILE_SIZE; ty <= (r.y1 - 1) / TILE_SIZE; ty++)
+    for (int tx = r.x0 / TILE_SIZE; tx <= (r.x1 - 1) / TILE_SIZE; tx++)
+      prepareTile(ty * tilesX + tx);
+}
+
+void Engine::prepareTile(int tile)
 {
-  memcpy(videoBuffer, clearScreenPtr, width * height * 3);
-  memcpy(videoBufferBack, clearScreenPtr, width * height * 3);
- 
-  for (int i = 0; i < width * height; i++)
+  if (tileEpoch[tile] == frameEpoch)
+    return;
+  tileEpoch[tile] = frameEpoch;
+
+  int x0 = (tile % tilesX) * TILE_SIZE;
+  int y0 = (tile / tilesX) * TILE_SIZE;
+  int x1 = std::min(x0 + TILE_SIZE, width);
+  for (int y = y0; y < std::min(y0 + TILE_SIZE, height); y++)
   {
-    pDepthBuffer[i] = 0;
+    if (useFixedPoint)
+    {
+      int32_t *row = &fixedDepthBuffer[(size_t)y * width];
+      std::fill(row + x0, row + x1, 0);
+      continue;
+    }
+    float *row = &pDepthBuffer[y * width];
+    std::fill(row + x0, row + x1, 0.0f);
   }
 }
 
 inline void Engine::setPixel(int x, int y, Color &color)
 {
-  uint32_t offset = (y * width + x) * 3;
-
-  videoBuffer[offset] = color.r;
-  videoBuffer[offset + 1] = color.g;
-  videoBuffer[offset + 2] = color.b;
+  setPixelTo(x, y, color, videoBuffer);
 }
 
 inline void Engine::setPixelTo(int x, int y, Color &color, uint8_t *buffer)
 {
-  uint32_t offset = (y * width + x) * 3;
-
-  buffer[offset] = color.r;
-  buffer[offset + 1] = color.g;
-  buffer[offset + 2] = color.b;
+  reinterpret_cast<uint32_t *>(buffer)[y * width + x] = packPixel(color.r, color.g, color.b);
 }
 
 inline Color Engine::getPixelFrom(int x, int y, uint8_t *buffer)
 {
-  uint32_t offset = (y * width + x) * 3;
+  uint32_t offset = (y * width + x) * 4;
   return {buffer[offset], buffer[offset + 1], buffer[offset + 2]};
 }
 
@@ -210,73 +458,12 @@ void Engine::SortVerticesByY(Vec3 &p1, Vec3 &p2, Vec3 &p3,
     }
 }
 
-void Engine::Dither_FloydSteinberg()
+void Engine::drawLine(int sx, int sy, int ex, int ey, Color color)
 {
-  int32_t w = width;
-  int32_t h = height;
-
-  memcpy(videoBufferBack, videoBuffer, w * h * 3);
-
-  constexpr float step = 16.0;
-  constexpr float step1 = 7.0f / step;
-  constexpr float step2 = 3.0f / step;
-  constexpr float step3 = 5.0f / step;
-  constexpr float step4 = 1.0f / step;
-
-  Color pixel;
-  int32_t error[3];
-  int32_t k[3];
-  Color p;
-  int px, py;
-
-  for (int y = 1; y < h - 1; y++)
-  {
-    for (int x = 1; x < w - 1; x++)
-    {
-      pixel = getPixelFrom(x, y, videoBufferBack);
-
-      Color qPixel = pixel;
-
-      error[0] = pixel.r - qPixel.r;
-      error[1] = pixel.g - qPixel.g;
-      error[2] = pixel.b - qPixel.b;
-
-      setPixelTo(x, y, qPixel, videoBufferBack);
-
-      auto updatePixel = [&x, &y, &error, &w, &h, &k, &p, &px, &py, this](const Vec2 &vOffset, const float fErrorBias)
-      {
-        px = x + vOffset.x;
-        py = y + vOffset.y;
-        if (px < 0)
-          px = 0;
-        if (py < 0)
-          py = 0;
-        if (px > w)
-          px = w;
-        if (py > h)
-          py = h;
-
-        p = this->getPixelFrom(px, py, videoBufferBack);
-
-        k[0] = p.r + int32_t(float(error[0]) * fErrorBias);
-        k[1] = p.g + int32_t(float(error[1]) * fErrorBias);
-        k[2] = p.b + int32_t(float(error[2]) * fErrorBias);
-
-        p.r = std::clamp(k[0], 0, 255);
-        p.g = std::clamp(k[1], 0, 255);
-        p.b = std::clamp(k[2], 0, 255);
-        setPixelTo(px, py, p, videoBufferBack);
-      };
-
-      updatePixel({1, 0}, step1);
-      updatePixel({-1, 1}, step2);
-      updatePixel({0, 1}, step3);
-      updatePixel({1, 1}, step4);
-    }
-  }
+  drawLine(sx, sy, ex, ey, color, screenRect);
 }
 
-void Engine::drawLine(int sx, int sy, int ex, int ey, Color color)
+void Engine::drawLine(int sx, int sy, int ex, int ey, Color color, const ScreenRect &clip)
 {
   float x{static_cast<float>(ex - sx)}, y{static_cast<float>(ey - sy)};
   const float max{std::max(std::fabs(x), std::fabs(y))};
@@ -286,148 +473,229 @@ void Engine::drawLine(int sx, int sy, int ex, int ey, Color color)
   float ly = (float)sy;
   for (int i = 0; i < (int)max; i++)
   {
-    setPixel((int)(lx), (int)(ly), color);
+    int px = floorToInt(lx);
+    int py = floorToInt(ly);
+    if (px >= clip.x0 && px < clip.x1 && py >= clip.y0 && py < clip.y1)
+      setPixel(px, py, color);
     lx += x;
     ly += y;
   }
 }
 
-// Implementation of ScanlineFillTexturedPart
-void Engine::ScanlineFillTexturedPart(int y_start, int y_end,
-                                    float x_edge1_current, const UV& uv_edge1_start_ref, float w_edge1_start_val,
-                                    float x_edge2_current, const UV& uv_edge2_start_ref, float w_edge2_start_val,
-                                    float dx_edge1_step, float du_edge1_step, float dv_edge1_step, float dw_edge1_step,
-                                    float dx_edge2_step, float du_edge2_step, float dv_edge2_step, float dw_edge2_step,
-                                    sf::Image &texture, const Color &base_color)
-{
-    float tex_ww = texture.getSize().x;
-    float tex_hh = texture.getSize().y;
-
-    // Create local copies for iterative updates of UVs and Ws along the edges
-    UV uv_edge1_current = uv_edge1_start_ref;
-    float w_edge1_current = w_edge1_start_val;
-    UV uv_edge2_current = uv_edge2_start_ref;
-    float w_edge2_current = w_edge2_start_val;
-
-    for (int i = y_start; i <= y_end; i++)
+// Modulates a texel with the triangle colour, applies fog and writes colour and depth
+inline void Engine::writeTexel(int x, int y, uint32_t c, float w, float cr, float cg, float cb)
+{
+    Color col;
+    col.r = static_cast<uint8_t>((c & 0xff) * cr);
+    col.g = static_cast<uint8_t>(((c >> 8) & 0xff) * cg);
+    col.b = static_cast<uint8_t>(((c >> 16) & 0xff) * cb);
+
+    float w_fog = std::clamp((w / 0.5f) * fogW, 0.0f, 1.0f);
+    col = mixRGB(col.r, col.g, col.b, fogColor.r, fogColor.g, fogColor.b, w_fog);
+
+    setPixel(x, y, col);
+
+    if (!useSort)
+        pDepthBuffer[y * width + x] = w;
+}
+
+// Span with u/v computed exactly only at segment ends (every spanSubdivision
+// pixels, or once per span in affine mode) and stepped in 16.16 in between.
+// w is computed exactly every spanSubdivision pixels and stepped by addition
+// in between. Segments are anchored at span.ax and a clipped segment still
+// steps w from its first pixel, so clipped spans step exactly like whole ones.
+// Texel coordinates truncate toward zero like the exact path's int casts.
+void Engine::ScanlineFillSubdividedSpan(int y, const SpanRow &s, int col_first, int col_last,
+                                        const Texture &texture, float cr, float cg, float cb)
+{
+    float tex_ww = texture.width;
+    float tex_hh = texture.height;
+
+    float tstep = 1.0f / static_cast<float>(s.bx - s.ax);
+    float dw = (s.w_e - s.w_s) * tstep;
+
+    float au = s.u_s / s.w_s;
+    float bu = s.u_e / s.w_e;
+    float av = s.v_s / s.w_s;
+    float bv = s.v_e / s.w_e;
+
+    // exact w and texel coordinates at column j, same formula as the per pixel path.
+    // Texel coordinates are 16.16 in 64 bits so repeated UVs on large textures
+    // and the segment offset products below can't overflow.
+    auto exactW = [&](int j)
     {
-        int ax = static_cast<int>(x_edge1_current);
-        int bx = static_cast<int>(x_edge2_current);
-
-        // Perspective-correct UVs and W for start and end of scanline
-        // These are already effectively calculated by the stepping from the main function
-        // u_s, v_s, w_s correspond to edge1; u_e, v_e, w_e correspond to edge2
-        float u_s_persp = uv_edge1_current.u / w_edge1_current;
-        float v_s_persp = uv_edge1_current.v / w_edge1_current;
-        float u_e_persp = uv_edge2_current.u / w_edge2_current;
-        float v_e_persp = uv_edge2_current.v / w_edge2_current;
-
-        // Local copies for swapping if ax > bx
-        float u_s = uv_edge1_current.u;
-        float v_s = uv_edge1_current.v;
-        float w_s = w_edge1_current;
-        float u_e = uv_edge2_current.u;
-        float v_e = uv_edge2_current.v;
-        float w_e = w_edge2_current;
-
-        if (ax > bx)
+        float t = static_cast<float>(j - s.ax) * tstep;
+        return (1.0f - t) * s.w_s + t * s.w_e;
+    };
+    auto exactAt = [&](int j, float &w, int64_t &U, int64_t &V)
+    {
+        float t = static_cast<float>(j - s.ax) * tstep;
+        w = (1.0f - t) * s.w_s + t * s.w_e;
+        U = toFixed16Wide(((1.0f - t) * au + t * bu) * w * tex_ww);
+        V = toFixed16Wide((1.0f - ((1.0f - t) * av + t * bv) * w) * tex_hh);
+    };
+
+    bool affine = textureMapping == TextureMapping::affine;
+    int seg = spanSubdivision;
+    int segFirst = s.ax + (col_first - s.ax) / seg * seg;
+    float *depthRow = &pDepthBuffer[y * width];
+
+    // affine mode interpolates u/v once across the whole span
+    float wIgnored;
+    int64_t UA = 0, VA = 0, UB, VB, dUA = 0, dVA = 0;
+    if (affine)
+    {
+        exactAt(s.ax, wIgnored, UA, VA);
+        exactAt(s.bx, wIgnored, UB, VB);
+        dUA = static_cast<int64_t>((UB - UA) * tstep);
+        dVA = static_cast<int64_t>((VB - VA) * tstep);
+    }
+
+    for (int s0 = segFirst; s0 < col_last; s0 += seg)
+    {
+        int s1 = std::min(s0 + seg, s.bx);
+
+        float w, w1;
+        int64_t U0, V0, U1, V1, dU, dV;
+        if (affine)
+        {
+            // only w is perspective correct here, u/v come from the span line
+            w = exactW(s0);
+            U0 = UA + dUA * (s0 - s.ax);
+            V0 = VA + dVA * (s0 - s.ax);
+            dU = dUA;
+            dV = dVA;
+        }
+        else
         {
-            std::swap(ax, bx);
-            std::swap(u_s, u_e);
-            std::swap(v_s, v_e);
-            std::swap(w_s, w_e);
+            exactAt(s0, w, U0, V0);
+            exactAt(s1, w1, U1, V1);
+            float inv = 1.0f / static_cast<float>(s1 - s0);
+            dU = static_cast<int64_t>((U1 - U0) * inv);
+            dV = static_cast<int64_t>((V1 - V0) * inv);
         }
 
-        if (ax == bx) { // Avoid division by zero for tstep if scanline is a point
-             x_edge1_current += dx_edge1_step;
-             uv_edge1_current.u += du_edge1_step;
-             uv_edge1_current.v += dv_edge1_step;
-             w_edge1_current += dw_edge1_step;
+        int j0 = std::max(s0, col_first);
+        int j1 = std::min(s1, col_last);
+        int64_t U = U0 + dU * (j0 - s0);
+        int64_t V = V0 + dV * (j0 - s0);
+        for (int j = s0; j < j0; j++)
+            w += dw;
 
-             x_edge2_current += dx_edge2_step;
-             uv_edge2_current.u += du_edge2_step;
-             uv_edge2_current.v += dv_edge2_step;
-             w_edge2_current += dw_edge2_step;
-            continue;
+        for (int j = j0; j < j1; j++, U += dU, V += dV, w += dw)
+        {
+            if (w == 0) continue;
+
+            if (w > depthRow[j] || useSort)
+                writeTexel(j, y, texture.fetch(fixed16Trunc(U), fixed16Trunc(V)), w, cr, cg, cb);
         }
+    }
+}
+
+// Implementation of ScanlineFillTexturedPart
+// Spans are the pixels inside the triangle's edge functions on each row,
+// narrowed to the clip rect only afterwards. Edge positions and span
+// parameters are derived from the row/column index instead of being
+// accumulated, so any sub-rectangle (clip) of the triangle gives exactly the
+// same pixels as drawing it whole.
+void Engine::ScanlineFillTexturedPart(int y_start, int y_end, float edge_y,
+                                    const EdgeWalk &edge1, const EdgeWalk &edge2,
+                                    const EdgeFunction edges[3], int x_first, int x_last,
+                                    const Texture &texture, const Color &base_color, const ScreenRect &clip)
+{
+    float tex_ww = texture.width;
+    float tex_hh = texture.height;
 
-        float tstep = 1.0f / static_cast<float>(bx - ax);
-        float t = 0.0f;
+    float cr = base_color.r / 255.0f;
+    float cg = base_color.g / 255.0f;
+    float cb = base_color.b / 255.0f;
 
-        for (int j = ax; j < bx; j++)
-        {
-            float w = (1.0f - t) * w_s + t * w_e;
-            if (w == 0) { t += tstep; continue; } // Avoid division by zero
+    int row_first = std::max(y_start, clip.y0);
+    int row_last = std::min(y_end, clip.y1 - 1);
 
-            // Perspective-correct interpolation for u and v across the scanline
-            float u_interp = ((1.0f - t) * u_s / w_s + t * u_e / w_e) * w; 
-            float v_interp = ((1.0f - t) * v_s / w_s + t * v_e / w_e) * w;
-            v_interp = 1.0f - v_interp; // Flip v for texture coordinate system
+    for (int i = row_first; i <= row_last; i++)
+    {
+        int ax = x_first, bx = x_last;
+        for (int k = 0; k < 3; k++)
+            edges[k].clipSpan(i, ax, bx);
+        if (ax >= bx)
+            continue;
 
-            if (i >= 0 && i < height && j >= 0 && j < width) { // Bounds check for screen
-                if (w > pDepthBuffer[i * width + j] || useSort)
-                {
-                    Color col;
-                    int tex_x = static_cast<int>(u_interp * tex_ww);
-                    int tex_y = static_cast<int>(v_interp * tex_hh);
+        SpanRow s;
+        spanAtRow(edge1, edge2, static_cast<float>(i) + 0.5f - edge_y, ax, bx, s);
 
-                    // Texture bounds check
-                    if (tex_x < 0) tex_x = 0; if (tex_x >= tex_ww) tex_x = tex_ww - 1;
-                    if (tex_y < 0) tex_y = 0; if (tex_y >= tex_hh) tex_y = tex_hh - 1;
+        float tstep = 1.0f / static_cast<float>(s.bx - s.ax);
 
-                    sf::Color c = texture.getPixel(tex_x, tex_y);
+        int col_first = std::max(s.ax, clip.x0);
+        int col_last = std::min(s.bx, clip.x1);
 
-                    float cr = base_color.r / 255.0f;
-                    float cg = base_color.g / 255.0f;
-                    float cb = base_color.b / 255.0f;
+        if (textureMapping != TextureMapping::exact)
+        {
+            if (col_first < col_last)
+                ScanlineFillSubdividedSpan(i, s, col_first, col_last, texture, cr, cg, cb);
+            continue;
+        }
 
-                    col.r = static_cast<uint8_t>(c.r * cr);
-                    col.g = static_cast<uint8_t>(c.g * cg);
-                    col.b = static_cast<uint8_t>(c.b * cb);
+        for (int j = col_first; j < col_last; j++)
+        {
+            float t = static_cast<float>(j - s.ax) * tstep;
+            float w = (1.0f - t) * s.w_s + t * s.w_e;
+            if (w == 0) continue; // Avoid division by zero
 
-                    float w_fog = std::clamp((w / 0.5f) * fogW, 0.0f, 1.0f);
-                    col = mixRGB(col.r, col.g, col.b, fogColor.r, fogColor.g, fogColor.b, w_fog);
+            // Perspective-correct interpolation for u and v across the scanline
+            float u_interp = ((1.0f - t) * s.u_s / s.w_s + t * s.u_e / s.w_e) * w;
+            float v_interp = ((1.0f - t) * s.v_s / s.w_s + t * s.v_e / s.w_e) * w;
+            v_interp = 1.0f - v_interp; // Flip v for texture coordinate system
 
-                    setPixel(j, i, col);
+            if (w > pDepthBuffer[i * width + j] || useSort)
+            {
+                int tex_x = static_cast<int>(u_interp * tex_ww);
+                int tex_y = static_cast<int>(v_interp * tex_hh);
 
-                    if (!useSort)
-                        pDepthBuffer[i * width + j] = w;
-                }
+                // wraps or clamps depending on the texture size
+                writeTexel(j, i, texture.fetch(tex_x, tex_y), w, cr, cg, cb);
             }
-            t += tstep;
         }
-        // Step along the edges for the next scanline
-        x_edge1_current += dx_edge1_step;
-        uv_edge1_current.u += du_edge1_step;
-        uv_edge1_current.v += dv_edge1_step;
-        w_edge1_current += dw_edge1_step;
-
-        x_edge2_current += dx_edge2_step;
-        uv_edge2_current.u += du_edge2_step;
-        uv_edge2_current.v += dv_edge2_step;
-        w_edge2_current += dw_edge2_step;
     }
 }
 
 void Engine::texturedTriangle(Vec3 &t1_in, UV &uv1_in, float w1_in,
                               Vec3 &t2_in, UV &uv2_in, float w2_in,
                               Vec3 &t3_in, UV &uv3_in, float w3_in,
-                              sf::Image &img, Color &color)
+                              const Texture &img, Color &color, const ScreenRect &clip)
 {
+  // coverage comes from the same snapped edge functions as the half-space kernel
+  int32_t sx[3] = {toSubpixel(t1_in.x), toSubpixel(t2_in.x), toSubpixel(t3_in.x)};
+  int32_t sy[3] = {toSubpixel(t1_in.y), toSubpixel(t2_in.y), toSubpixel(t3_in.y)};
+  EdgeFunction edges[3];
+  int order[3];
+  if (!triangleEdges(sx, sy, edges, order))
+    return;
+
+  // pixels whose centers lie in the snapped bounding box, before clipping
+  int x_first = subpixelCeilCenter(std::min({sx[0], sx[1], sx[2]}));
+  int x_last = ((std::max({sx[0], sx[1], sx[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1;
+  int y_first = subpixelCeilCenter(std::min({sy[0], sy[1], sy[2]}));
+  int y_last = ((std::max({sy[0], sy[1], sy[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1;
+  if (x_first >= x_last || y_first >= y_last)
+    return;
+
+  // attributes are walked along the snapped edges too
   Vec3 p1 = t1_in; Vec3 p2 = t2_in; Vec3 p3 = t3_in;
+  p1.x = sx[0] * (1.0f / SUBPIXEL_ONE); p1.y = sy[0] * (1.0f / SUBPIXEL_ONE);
+  p2.x = sx[1] * (1.0f / SUBPIXEL_ONE); p2.y = sy[1] * (1.0f / SUBPIXEL_ONE);
+  p3.x = sx[2] * (1.0f / SUBPIXEL_ONE); p3.y = sy[2] * (1.0f / SUBPIXEL_ONE);
   UV tex1 = uv1_in; UV tex2 = uv2_in; UV tex3 = uv3_in;
   float w_val1 = w1_in; float w_val2 = w2_in; float w_val3 = w3_in;
 
   SortVerticesByY(p1, p2, p3, tex1, tex2, tex3, w_val1, w_val2, w_val3);
 
-  int y1 = static_cast<int>(p1.y); int y2 = static_cast<int>(p2.y); int y3 = static_cast<int>(p3.y);
-
   // Deltas for the major triangle edges (p1-p2 and p1-p3)
   float dx12_step = 0, du12_step = 0, dv12_step = 0, dw12_step = 0; // Edge p1-p2
   float dx13_step = 0, du13_step = 0, dv13_step = 0, dw13_step = 0; // Edge p1-p3
   float dx23_step = 0, du23_step = 0, dv23_step = 0, dw23_step = 0; // Edge p2-p3
 
-  if (y2 - y1 > 0) {
+  if (p2.y > p1.y) {
       float inv_dy12 = 1.0f / (p2.y - p1.y);
       dx12_step = (p2.x - p1.x) * inv_dy12;
       du12_step = (tex2.u - tex1.u) * inv_dy12;
@@ -435,7 +703,7 @@ void Engine::texturedTriangle(Vec3 &t1_in, UV &uv1_in, float w1_in,
       dw12_step = (w_val2 - w_val1) * inv_dy12;
   }
 
-  if (y3 - y1 > 0) {
+  if (p3.y > p1.y) {
       float inv_dy13 = 1.0f / (p3.y - p1.y);
       dx13_step = (p3.x - p1.x) * inv_dy13;
       du13_step = (tex3.u - tex1.u) * inv_dy13;
@@ -443,7 +711,7 @@ void Engine::texturedTriangle(Vec3 &t1_in, UV &uv1_in, float w1_in,
       dw13_step = (w_val3 - w_val1) * inv_dy13;
   }
 
-  if (y3 - y2 > 0) {
+  if (p3.y > p2.y) {
       float inv_dy23 = 1.0f / (p3.y - p2.y);
       dx23_step = (p3.x - p2.x) * inv_dy23;
       du23_step = (tex3.u - tex2.u) * inv_dy23;
@@ -451,63 +719,37 @@ void Engine::texturedTriangle(Vec3 &t1_in, UV &uv1_in, float w1_in,
       dw23_step = (w_val3 - w_val2) * inv_dy23;
   }
 
+  // rows whose pixel centers are above p2 belong to the top part
+  int y_split = subpixelCeilCenter(toSubpixel(p2.y));
+
   // Top part of the triangle (p1 to p2)
-  if (y2 - y1 > 0) {
-      ScanlineFillTexturedPart(y1, y2 -1, // Iterate up to y2-1 because y2 is the start of the next part
-                               p1.x, tex1, w_val1,
-                               p1.x, tex1, w_val1,
-                               dx12_step, du12_step, dv12_step, dw12_step,
-                               dx13_step, du13_step, dv13_step, dw13_step,
-                               img, color);
+  if (y_first < y_split) {
+      EdgeWalk edge12 = {p1.x, tex1.u, tex1.v, w_val1, dx12_step, du12_step, dv12_step, dw12_step};
+      EdgeWalk edge13 = {p1.x, tex1.u, tex1.v, w_val1, dx13_step, du13_step, dv13_step, dw13_step};
+      ScanlineFillTexturedPart(y_first, std::min(y_split, y_last) - 1, p1.y, edge12, edge13,
+                               edges, x_first, x_last, img, color, clip);
   }
 
   // Bottom part of the triangle (p2 to p3)
-  if (y3 - y2 > 0) {
-      // Calculate the intersection point M on edge p1-p3 at height y2
-      float My = static_cast<float>(y2);
-      float Mx, Mu, Mv, Mw;
-
-      if (y3 - y1 == 0) { // Avoid division by zero if p1 and p3 have same y (should not happen if p1,p2,p3 distinct and sorted)
-          Mx = p1.x; // Or some other sensible default / error handling
-          Mw = w_val1;
-          Mu = tex1.u;
-          Mv = tex1.v;
-      } else {
-          float t_intersect = (My - p1.y) / (p3.y - p1.y);
-          Mx = p1.x + t_intersect * (p3.x - p1.x);
-          Mw = w_val1 + t_intersect * (w_val3 - w_val1);
-          if (Mw == 0) Mw = 1e-6f; // Avoid division by zero for UV calculation
-          
-          float u1_over_w1 = (w_val1 == 0) ? 0 : tex1.u / w_val1;
-          float v1_over_w1 = (w_val1 == 0) ? 0 : tex1.v / w_val1;
-          float u3_over_w3 = (w_val3 == 0) ? 0 : tex3.u / w_val3;
-          float v3_over_w3 = (w_val3 == 0) ? 0 : tex3.v / w_val3;
-
-          Mu = ((1.0f - t_intersect) * u1_over_w1 + t_intersect * u3_over_w3) * Mw;
-          Mv = ((1.0f - t_intersect) * v1_over_w1 + t_intersect * v3_over_w3) * Mw;
-      }
-      UV texM = {Mu, Mv, Mw}; // Mw is also stored in texM.w for consistency if needed by ScanlineFill
-
-      ScanlineFillTexturedPart(y2, y3,
-                               p2.x, tex2, w_val2,                     // Start of edge 1 (p2)
-                               Mx, texM, Mw,                           // Start of edge 2 (Point M on p1-p3)
-                               dx23_step, du23_step, dv23_step, dw23_step, // Steps for edge 1 (p2-p3)
-                               dx13_step, du13_step, dv13_step, dw13_step, // Steps for edge 2 (p1-p3, continued from M)
-                               img, color);
+  if (y_split < y_last) {
+      // edge p1-p3 continued from M, its point at the height of p2
+      float dy = p2.y - p1.y;
+      EdgeWalk edge23 = {p2.x, tex2.u, tex2.v, w_val2, dx23_step, du23_step, dv23_step, dw23_step};
+      EdgeWalk edgeM3 = {p1.x + dy * dx13_step, tex1.u + dy * du13_step, tex1.v + dy * dv13_step, w_val1 + dy * dw13_step,
+                         dx13_step, du13_step, dv13_step, dw13_step};
+      ScanlineFillTexturedPart(std::max(y_split, y_first), y_last - 1, p2.y, edge23, edgeM3,
+                               edges, x_first, x_last, img, color, clip);
   }
-
-  stData.numOfTrianglesPerFrame++;
-  stData.numOfTrianglesPerSecond++;
 }
 
-void Engine::drawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Color color)
+void Engine::drawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Color color, const ScreenRect &clip)
 {
-  drawLine(x1, y1, x2, y2, color);
-  drawLine(x2, y2, x3, y3, color);
-  drawLine(x1, y1, x3, y3, color);
+  drawLine(x1, y1, x2, y2, color, clip);
+  drawLine(x2, y2, x3, y3, color, clip);
+  drawLine(x1, y1, x3, y3, color, clip);
 }
 
-void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
+void Engine::fillTriangle(Vec3 t1, Vec3 t2, Vec3 t3, Color color, const ScreenRect &clip)
 {
   Vec3 AUX;
   if (t1.y > t2.y)
@@ -529,12 +771,12 @@ void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
     t3 = AUX;
   }
 
-  int p0x = t1.x;
-  int p0y = t1.y;
-  int p1x = t2.x;
-  int p1y = t2.y;
-  int p2x = t3.x;
-  int p2y = t3.y;
+  int p0x = floorToInt(t1.x);
+  int p0y = floorToInt(t1.y);
+  int p1x = floorToInt(t2.x);
+  int p1y = floorToInt(t2.y);
+  int p2x = floorToInt(t3.x);
+  int p2y = floorToInt(t3.y);
 
   int x1 = 0;
   int x2 = 0;
@@ -549,10 +791,10 @@ void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
   {
     slope1 = ((double)p1x - p0x) / (p1y - p0y);
     slope2 = ((double)p2x - p0x) / (p2y - p0y);
-    for (int i = 0; i < p1y - p0y; i++)
+    for (int i = std::max(0, clip.y0 - p0y); i < std::min(p1y, clip.y1) - p0y; i++)
     {
-      x1 = p0x + i * slope1;
-      x2 = p0x + i * slope2;
+      x1 = floorToInt(p0x + i * slope1);
+      x2 = floorToInt(p0x + i * slope2);
       y = p0y + i;
 
       if (x1 > x2)
@@ -564,9 +806,8 @@ void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
 
       if (x2 > x1)
       {
-        for (int j = 0; j <= x2 - x1; j++)
+        for (x = std::max(x1, clip.x0); x <= std::min(x2, clip.x1 - 1); x++)
         {
-          x = x1 + j;
           setPixel(x, y, color);
         }
       }
@@ -578,10 +819,10 @@ void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
     slope1 = ((double)p2x - p1x) / (p2y - p1y);
     slope2 = ((double)p2x - p0x) / (p2y - p0y);
     sx = p2x - (p2y - p1y) * slope2;
-    for (int i = 0; i < p2y - p1y; i++)
+    for (int i = std::max(0, clip.y0 - p1y); i < std::min(p2y, clip.y1) - p1y; i++)
     {
-      x1 = p1x + i * slope1;
-      x2 = sx + i * slope2;
+      x1 = floorToInt(p1x + i * slope1);
+      x2 = floorToInt(sx + i * slope2);
       y = p1y + i;
 
       if (x1 > x2)
@@ -593,39 +834,95 @@ void Engine::fillTriangle(Vec3 &t1, Vec3 &t2, Vec3 &t3, Color color)
 
       if (x2 > x1)
       {
-        for (int x = x1 + 1; x <= x2; x++)
+        for (x = std::max(x1 + 1, clip.x0); x <= std::min(x2, clip.x1 - 1); x++)
         {
           setPixel(x, y, color);
         }
       }
     }
   }
+}
 
-  stData.numOfTrianglesPerFrame++;
-  stData.numOfTrianglesPerSecond++;
+ScreenRect Engine::triangleBounds(const Triangle &tri) const
+{
+  float minX = std::min({tri.p[0].x, tri.p[1].x, tri.p[2].x});
+  float maxX = std::max({tri.p[0].x, tri.p[1].x, tri.p[2].x});
+  float minY = std::min({tri.p[0].y, tri.p[1].y, tri.p[2].y});
+  float maxY = std::max({tri.p[0].y, tri.p[1].y, tri.p[2].y});
+
+  // clamped to what the clipper keeps, so guard band triangles that skip it
+  // cover the same pixels as clipped ones
+  return {std::max(floorToInt(minX), rasterRect.x0),
+          std::max(floorToInt(minY), rasterRect.y0),
+          std::min(floorToInt(maxX) + 1, rasterRect.x1),
+          std::min(floorToInt(maxY) + 1, rasterRect.y1)};
+}
+
+// Picks the level whose texels are closest to pixel sized, from the ratio of the
+// triangle's area in level 0 texels to its area on screen. Each level down
+// quarters the texel area. Rounds towards the sharper level.
+const Texture &Engine::selectMipLevel(const Triangle &tri, const Texture &texture) const
+{
+  if (!useMipmaps || texture.mips.empty())
+    return texture;
+
+  float screenArea = fabsf((tri.p[1].x - tri.p[0].x) * (tri.p[2].y - tri.p[0].y) -
+                           (tri.p[2].x - tri.p[0].x) * (tri.p[1].y - tri.p[0].y));
+  float uvArea = fabsf((tri.t[1].u - tri.t[0].u) * (tri.t[2].v - tri.t[0].v) -
+                       (tri.t[2].u - tri.t[0].u) * (tri.t[1].v - tri.t[0].v));
+  float texelArea = uvArea * texture.width * texture.height;
+
+  int level = 0;
+  while (level < texture.levelCount() - 1 && texelArea >= 4.0f * screenArea)
+  {
+    texelArea *= 0.25f;
+    level++;
+  }
+  return texture.level(level);
 }
 
 void Engine::renderTriangle(Triangle &triangle, int textureID)
 {
+  renderTriangle(triangle, textureID, screenRect);
+}
+
+void Engine::renderTriangle(Triangle &triangle, int textureID, const ScreenRect &clip)
+{
+  // keep spans inside the triangle's own bounds, steep edges can overshoot them
+  ScreenRect bounds = triangleBounds(triangle);
+  ScreenRect r = {std::max(bounds.x0, clip.x0), std::max(bounds.y0, clip.y0),
+                  std::min(bounds.x1, clip.x1), std::min(bounds.y1, clip.y1)};
+  if (r.x0 >= r.x1 || r.y0 >= r.y1)
+    return;
+
   switch (rMode)
   {
   case RenderMode::textured:
-    if (textureID >= 0 && textureID < textureImage.size()) {
-      texturedTriangle(triangle.p[0], triangle.t[0], triangle.t[0].w,
-                      triangle.p[1], triangle.t[1], triangle.t[1].w,
-                      triangle.p[2], triangle.t[2], triangle.t[2].w,
-                      textureImage[textureID], triangle.color);
+    // textures still loading have no slot contents yet, draw those triangles flat
+    if (textureID >= 0 && (size_t)textureID < textures.size() && textures[textureID]) {
+      const Texture &texture = selectMipLevel(triangle, *textures[textureID]);
+      if (useFixedPoint) {
+        texturedTriangleFixed(triangle, texture, triangle.color, r);
+        break;
+      }
+      // triangles too large for the half-space kernel's edge functions take the scanline one
+      bool drawn = rasterKernel == RasterKernel::halfSpace && HalfSpaceFillTextured(triangle, texture, triangle.color, r);
+      if (!drawn)
+        texturedTriangle(triangle.p[0], triangle.t[0], triangle.t[0].w,
+                        triangle.p[1], triangle.t[1], triangle.t[1].w,
+                        triangle.p[2], triangle.t[2], triangle.t[2].w,
+                        texture, triangle.color, r);
     } else {
-      fillTriangle(triangle.p[0], triangle.p[1], triangle.p[2], triangle.color);
+      fillTriangle(triangle.p[0], triangle.p[1], triangle.p[2], triangle.color, r);
     }
     break;
   case RenderMode::filled:
-    fillTriangle(triangle.p[0], triangle.p[1], triangle.p[2], triangle.color);
+    fillTriangle(triangle.p[0], triangle.p[1], triangle.p[2], triangle.color, r);
     break;
   case RenderMode::wireframe:
-    drawTriangle(triangle.p[0].x, triangle.p[0].y,
-                triangle.p[1].x, triangle.p[1].y,
-                triangle.p[2].x, triangle.p[2].y, triangle.color);
+    drawTriangle(floorToInt(triangle.p[0].x), floorToInt(triangle.p[0].y),
+                floorToInt(triangle.p[1].x), floorToInt(triangle.p[1].y),
+                floorToInt(triangle.p[2].x), floorToInt(triangle.p[2].y), triangle.color, r);
     break;
   default:
     break;
@@ -639,11 +936,27 @@ float Engine::getClock()
 
 bool Engine::isOpen()
 {
+  if (headless)
+    return true;
+
   return window.isOpen();
 }
 
+bool Engine::isHeadless() const
+{
+  return headless;
+}
+
+const uint8_t *Engine::getFrameBuffer() const
+{
+  return useDither ? videoBufferBack : videoBuffer;
+}
+
 void Engine::checkEvents()
 {
+  if (headless)
+    return;
+
   sf::Event event{};
   while (window.pollEvent(event))
   {
@@ -652,30 +965,12 @@ void Engine::checkEvents()
   }
 }
 
-void Engine::copyVideoBuffer(uint8_t *buffer)
-{
-  Color c;
-  uint32_t offset;
-
-  for (int y = 0; y < height; y++)
-  {
-    for (int x = 0; x < width; x++)
-    {
-      offset = (y * width + x) * 3;
-
-      c.r = buffer[offset];
-      c.g = buffer[offset + 1];
-      c.b = buffer[offset + 2];
-
-      screenBuffer.setPixel(x, y, sf::Color{c.r, c.g, c.b, 255});
-    }
-  }
-}
-
 void Engine::renderDebugData()
 {
   if (stData.fps_graph.size() > 1)
   {
+    prepareTiles({0, 0, std::min(stData.graphSize + 1, width), std::min(25, height)});
+
     float max_fps = 0;
     float min_fps = 10000;
 
@@ -714,6 +1009,9 @@ void Engine::renderDebugData()
 
 void Engine::render(int debugMode)
 {
+  if (clearPending)
+    clear();
+
   rasterize();
 
   if (debugMode) {
@@ -721,18 +1019,26 @@ void Engine::render(int debugMode)
   }
 
   if (useDither) {
-    Dither_FloydSteinberg();
-    copyVideoBuffer(videoBufferBack);
-  } else {
-    copyVideoBuffer(videoBuffer);
+    if (ditherMode == DitherMode::ordered)
+      Dither_Ordered();
+    else
+      Dither_FloydSteinberg();
   }
 
-  screenTexture.update(screenBuffer);
-  window.draw(sprite);
-  sprite.setPosition(0, 0);
-  window.display();
+  // headless: leave the frame in videoBuffer(Back) for getFrameBuffer(), the next render() clears it
+  if (!headless)
+  {
+    screenTexture.update(useDither ? videoBufferBack : videoBuffer);
+    window.draw(sprite);
+    sprite.setPosition(0, 0);
+    window.display();
 
-  clear();
+    clear();
+  }
+  else
+  {
+    clearPending = true;
+  }
 
   deltaTime = clock.restart().asSeconds();
 
@@ -755,7 +1061,8 @@ void Engine::render(int debugMode)
         stData.fps_graph.erase(stData.fps_graph.begin() + 0);
 
       printf("%s\n", titleText);
-      window.setTitle(titleText);
+      if (!headless)
+        window.setTitle(titleText);
 
       fpsCounter = dt = 0;
       stData.numOfTrianglesPerSecond = 0;
@@ -770,235 +1077,694 @@ void Engine::render(int debugMode)
   stData.numOfTrianglesPerFrame = 0;
 }
 
-bool Engine::checkIfAABBisOnScreen(AABB &aabb, mat4x4 &matWorld, mat4x4 &matView)
+// Screen extent of a model space box. Fails when a corner reaches past the
+// z = 1 near plane, the extent is unbounded then.
+bool Engine::projectAABB(const AABB &box, mat4x4 &worldViewProj, ProjectedBounds &bounds) const
 {
-  Triangle triProjected, triTransformed, triViewed;
+  bounds = {1e30f, 1e30f, -1e30f, -1e30f, 0.0f};
+  for (int i = 0; i < 8; i++)
+  {
+    Vec3 corner = {i & 1 ? box.max.x : box.min.x,
+                   i & 2 ? box.max.y : box.min.y,
+                   i & 4 ? box.max.z : box.min.z};
+    Vec3 clip = Matrix_MultiplyVector(worldViewProj, corner);
+    if (clip.w < 1.0f)
+      return false;
+    float x = (clip.x / clip.w + 1.0f) * 0.5f * width;
+    float y = (clip.y / clip.w + 1.0f) * 0.5f * height;
+    bounds.minX = std::min(bounds.minX, x);
+    bounds.maxX = std::max(bounds.maxX, x);
+    bounds.minY = std::min(bounds.minY, y);
+    bounds.maxY = std::max(bounds.maxY, y);
+    bounds.nearestW = std::max(bounds.nearestW, 1.0f / clip.w);
+  }
+  return true;
+}
 
-  int nClippedTriangles = 0;
-  Triangle clipped[2];
-  Vec3 av = {0, 0, 1};
-  Vec3 bc = {0, 0, 1};
+// Level of detail from the screen area of the mesh's projected AABB. Each level
+// halves the triangles, so one level down doubles the pixels per triangle.
+// Meshes without bounds (reaching past the near plane) always get level 0.
+int Engine::selectMeshLod(const MeshData &data, const ProjectedBounds *bounds) const
+{
+  if (data.lodCount() == 1 || !bounds)
+    return 0;
 
-  std::vector<Vec3> verts;
-  verts.push_back({aabb.min.x, aabb.min.y, aabb.min.z});
-  verts.push_back({aabb.max.x, aabb.min.y, aabb.min.z});
-  verts.push_back({aabb.min.x, aabb.min.y, aabb.max.z});
-  verts.push_back({aabb.max.x, aabb.min.y, aabb.max.z});
+  float area = (bounds->maxX - bounds->minX) * (bounds->maxY - bounds->minY);
+  float pixelsPerTriangle = area / data.triangleCount();
+  if (pixelsPerTriangle <= 0.0f)
+    return data.lodCount() - 1;
 
-  verts.push_back({aabb.min.x, aabb.max.y, aabb.min.z});
-  verts.push_back({aabb.max.x, aabb.max.y, aabb.min.z});
-  verts.push_back({aabb.min.x, aabb.max.y, aabb.max.z});
-  verts.push_back({aabb.max.x, aabb.max.y, aabb.max.z});
+  float level = log2f(LOD_PIXELS_PER_TRIANGLE / pixelsPerTriangle) + lodBias;
+  return std::max(0, std::min(static_cast<int>(level), data.lodCount() - 1));
+}
 
-  int k = 0;
+void Engine::updateCullTree()
+{
+  size_t count = components.components.size();
+  for (size_t i = count; i < cullLeaves.size(); i++)
+  {
+    if (cullLeaves[i] >= 0)
+      cullTree.remove(cullLeaves[i]);
+  }
+  cullLeaves.resize(count, -1);
 
-  for (int a = 0; a < 8; a++)
+  for (size_t i = 0; i < count; i++)
   {
-    if (a == 0)
-    {
-      triViewed.p[0] = verts[0];
-      triViewed.p[1] = verts[1];
-      triViewed.p[2] = verts[2];
-    }
-    else if (a == 1)
-    {
-      triViewed.p[0] = verts[1];
-      triViewed.p[1] = verts[2];
-      triViewed.p[2] = verts[3];
-    }
-    else if (a == 2)
+    const Component &component = components.components[i];
+    int &leaf = cullLeaves[i];
+    if (!component.worldChanged && (leaf >= 0) == component.hasBounds)
+      continue;
+
+    if (!component.hasBounds)
     {
-      triViewed.p[0] = verts[1];
-      triViewed.p[1] = verts[0];
-      triViewed.p[2] = verts[5];
+      if (leaf >= 0)
+        cullTree.remove(leaf);
+      leaf = -1;
     }
-    else if (a == 3)
+    else if (leaf < 0)
     {
-      triViewed.p[0] = verts[0];
-      triViewed.p[1] = verts[5];
-      triViewed.p[2] = verts[4];
+      leaf = cullTree.insert(component.worldBox, static_cast<int>(i));
     }
-    else if (a == 4)
+    else
     {
-      triViewed.p[0] = verts[2];
-      triViewed.p[1] = verts[7];
-      triViewed.p[2] = verts[6];
+      cullTree.move(leaf, component.worldBox);
     }
-    else if (a == 5)
+  }
+}
+
+void Engine::calculateTriangles(Vec3 &camera, Vec3 &vTarget, Vec3 &vUp)
+{
+  // the list built while the last frame was drawn is the one drawn now
+  if (finishGeometry())
+  {
+    vecTrianglesToRaster.swap(pipelineTriangles);
+    displayedFrame = pipelineFrame;
+  }
+  else
+  {
+    vecTrianglesToRaster.clear();
+  }
+
+  submittedFrame++;
+  prepareFrame(camera, vTarget, vUp);
+
+  if (!usePipeline)
+  {
+    buildGeometry(vecTrianglesToRaster);
+    displayedFrame = submittedFrame;
+    return;
+  }
+
+  pipelineFrame = submittedFrame;
+  auto done = std::make_shared<std::promise<void>>();
+  geometryInFlight = done->get_future();
+  geometryThread.submit([this, done]
+                        {
+                          try {
+                            buildGeometry(pipelineTriangles);
+                            done->set_value();
+                          } catch (...) {
+                            done->set_exception(std::current_exception());
+                          } });
+}
+
+// Waits for the geometry thread, returns true if it was building a frame.
+bool Engine::finishGeometry()
+{
+  if (!geometryInFlight.valid())
+    return false;
+
+  std::future<void> inFlight = std::move(geometryInFlight);
+  inFlight.get();
+  return true;
+}
+
+// Everything that reads or changes the scene: loads are published, world
+// matrices and the tree updated, and the meshes in the view frustum collected
+// with their transforms and lods. The meshes are copied, so their geometry
+// stays alive for buildGeometry() whatever the application does meanwhile.
+void Engine::prepareFrame(Vec3 &camera, Vec3 &vTarget, Vec3 &vUp)
+{
+  publishLoadedAssets();
+
+  mat4x4 matCamera = Matrix_PointAt(camera, vTarget, vUp);
+  mat4x4 matView = Matrix_QuickInverse(matCamera);
+
+  meshTransforms.clear();
+  visibleMeshes.clear();
+
+  // culling and lighting happen in view space, so rotate the light there once
+  Vec3 light_direction = {1, -1, -1};
+  light_direction = Vector_Normalise(light_direction);
+  geometrySettings.lightView = {
+      light_direction.x * matView.m[0][0] + light_direction.y * matView.m[1][0] + light_direction.z * matView.m[2][0],
+      light_direction.x * matView.m[0][1] + light_direction.y * matView.m[1][1] + light_direction.z * matView.m[2][1],
+      light_direction.x * matView.m[0][2] + light_direction.y * matView.m[1][2] + light_direction.z * matView.m[2][2]};
+  geometrySettings.sort = useSort;
+  geometrySettings.sortMethod = sortMethod;
+  geometrySettings.orderingTableSize = orderingTableSize;
+  geometrySettings.occlusion = useOcclusion;
+  geometrySettings.fixedPoint = useFixedPoint;
+
+  if (components.components.empty()) {
+    return;
+  }
+
+  // only components that moved, or whose ancestors or meshes changed, are touched
+  components.updateWorld();
+
+  // the tree rejects whole groups of components outside the view frustum
+  updateCullTree();
+
+  // Nothing past the projection's far plane is drawn. Fog weighs a texel by
+  // 2 * fogW / z, below 1/255 (z > 510 * fogW) the texel no longer shows.
+  float fogEnd = fogW * 2.0f * 255.0f;
+  mat4x4 matViewProj = Matrix_MultiplyMatrix(matView, matProj);
+  Frustum frustum;
+  float drawEnd = std::min(farClip, fogEnd);
+  frustum.fromMatrix(matViewProj, 1.0f, drawEnd);
+  geometrySettings.orderingTableScale = orderingTableSize / std::max(drawEnd - 1.0f, 1.0f);
+
+  visibleComponents.clear();
+  cullTree.query(frustum, [&](int i)
+                 { visibleComponents.push_back(i); });
+  // the tree reports in no particular order, the draw order stays the component order
+  std::sort(visibleComponents.begin(), visibleComponents.end());
+
+  for (int i : visibleComponents)
+  {
+    Component &component = components.components[i];
+
+    for (size_t m = 0; m < component.meshes.meshes.size(); m++)
     {
-      triViewed.p[0] = verts[3];
-      triViewed.p[1] = verts[7];
-      triViewed.p[2] = verts[2];
+      Mesh &mesh = component.meshes.meshes[m];
+      if (mesh.triangleCount() == 0) {
+        continue;
+      }
+
+      if (frustum.classify(component.meshWorldBoxes[m]) == Frustum::outside) {
+        continue;
+      }
+
+      MeshTransform mt;
+      mt.worldView = Matrix_MultiplyMatrix(component.transform.matWorld, matView);
+      mt.worldViewProj = Matrix_MultiplyMatrix(mt.worldView, matProj);
+      size_t transform = meshTransforms.size();
+      meshTransforms.push_back(mt);
+
+      VisibleMesh vm;
+      vm.mesh = mesh;
+      vm.transform = transform;
+      vm.projected = projectAABB(mesh.data->aabb, meshTransforms[transform].worldViewProj, vm.bounds);
+      vm.lod = &mesh.data->lod(selectMeshLod(*mesh.data, vm.projected ? &vm.bounds : nullptr));
+      vm.markedOccluder = component.occluder;
+      vm.visible = true;
+      vm.occluder = false;
+      visibleMeshes.push_back(vm);
     }
-    else if (a == 6)
+  }
+}
+
+// Turns the meshes collected by prepareFrame() into the frame's screen space
+// triangles in 'out'. Only uses state owned by the geometry stage, so it can
+// run on the geometry thread while the last frame is rasterized.
+void Engine::buildGeometry(std::vector<Triangle> &out)
+{
+  out.clear();
+
+  // vertices and triangles are split into jobs
+  vertexJobs.clear();
+  geometryJobs.clear();
+  size_t vertexCount = 0;
+
+  if (geometrySettings.occlusion)
+    cullOccluded();
+
+  for (const VisibleMesh &vm : visibleMeshes)
+  {
+    if (!vm.visible)
+      continue;
+
+    const MeshData *lod = vm.lod;
+
+    for (size_t first = 0; first < lod->vertexCount(); first += GEOMETRY_CHUNK)
     {
-      triViewed.p[0] = verts[5];
-      triViewed.p[1] = verts[7];
-      triViewed.p[2] = verts[6];
+      size_t last = std::min(first + GEOMETRY_CHUNK, lod->vertexCount());
+      vertexJobs.push_back({&vm.mesh, lod, first, last, vertexCount, vm.transform});
     }
-    else if (a == 7)
+
+    for (size_t first = 0; first < lod->triangleCount(); first += GEOMETRY_CHUNK)
     {
-      triViewed.p[0] = verts[4];
-      triViewed.p[1] = verts[5];
-      triViewed.p[2] = verts[6];
+      size_t last = std::min(first + GEOMETRY_CHUNK, lod->triangleCount());
+      geometryJobs.push_back({&vm.mesh, lod, first, last, vertexCount, vm.transform});
     }
 
-    triTransformed.p[0] = Matrix_MultiplyVector(matWorld, triViewed.p[0]);
-    triTransformed.p[1] = Matrix_MultiplyVector(matWorld, triViewed.p[1]);
-    triTransformed.p[2] = Matrix_MultiplyVector(matWorld, triViewed.p[2]);
+    vertexCount += lod->vertexCount();
+  }
 
-    triViewed.p[0] = Matrix_MultiplyVector(matView, triTransformed.p[0]);
-    triViewed.p[1] = Matrix_MultiplyVector(matView, triTransformed.p[1]);
-    triViewed.p[2] = Matrix_MultiplyVector(matView, triTransformed.p[2]);
+  if (viewVertices.size() < vertexCount)
+  {
+    viewVertices.resize(vertexCount);
+    clipVertices.resize(vertexCount);
+    clipW.resize(vertexCount);
+  }
+  if (geometrySettings.fixedPoint && fixedClipVertices.size() < vertexCount)
+    fixedClipVertices.resize(vertexCount);
 
-    nClippedTriangles = Triangle_CLipAgainstPlane(av, bc, triViewed, clipped[0], clipped[1]);
+  if (geometryBins.size() < geometryJobs.size())
+  {
+    geometryBins.resize(geometryJobs.size());
+    geometryKeys.resize(geometryJobs.size());
+  }
 
-    if (nClippedTriangles == 0)
-      continue;
+  workers.parallelFor(vertexJobs.size(), [&](size_t j)
+                      { transformVertices(vertexJobs[j]); });
+
+  workers.parallelFor(geometryJobs.size(), [&](size_t j)
+                      {
+                        geometryBins[j].clear();
+                        if (geometrySettings.fixedPoint)
+                          assembleTrianglesFixed(geometryJobs[j], geometrySettings.lightView, geometryBins[j]);
+                        else
+                          assembleTriangles(geometryJobs[j], geometrySettings.lightView, geometryBins[j]);
+                        if (geometrySettings.sort)
+                          computeSortKeys(geometryBins[j], geometryKeys[j]); });
 
-    k++;
+  if (geometrySettings.sort)
+  {
+    joinSorted(out);
+    return;
   }
 
-  if (k > 0)
-    return true;
+  // join in job order so the output matches the serial version exactly
+  size_t total = 0;
+  for (size_t j = 0; j < geometryJobs.size(); j++)
+    total += geometryBins[j].size();
 
-  return false;
+  out.reserve(total);
+  for (size_t j = 0; j < geometryJobs.size(); j++)
+    out.insert(out.end(), geometryBins[j].begin(), geometryBins[j].end());
 }
-void Engine::calculateTriangles(Vec3 &camera, Vec3 &vTarget, Vec3 &vUp)
+
+// Sort keys of projected triangles, ascending is back to front. t[i].w holds
+// 1/z, and the average NDC z the painter's order used to compare is a falling
+// function of its sum, so the radix key is the sum's float bits (positive
+// floats order like their bit patterns). Ordering table buckets are linear in
+// the harmonic mean of the vertex depths instead, like the PS1's OTZ.
+void Engine::computeSortKeys(const std::vector<Triangle> &triangles, std::vector<uint32_t> &keys) const
 {
-  vecTrianglesToRaster.clear();
+  keys.resize(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    const Triangle &t = triangles[i];
+    float sumW = t.t[0].w + t.t[1].w + t.t[2].w;
 
-  mat4x4 matCamera = Matrix_PointAt(camera, vTarget, vUp);
-  mat4x4 matView = Matrix_QuickInverse(matCamera);
-  mat4x4 matTrans;
+    if (geometrySettings.sortMethod == SortMethod::radix)
+    {
+      uint32_t bits;
+      memcpy(&bits, &sumW, sizeof(bits));
+      keys[i] = bits;
+      continue;
+    }
+
+    int size = geometrySettings.orderingTableSize;
+    float bucket = (3.0f / sumW - 1.0f) * geometrySettings.orderingTableScale;
+    int b = bucket < size ? static_cast<int>(std::max(bucket, 0.0f)) : size - 1;
+    keys[i] = size - 1 - b;
+  }
+}
 
-  int numOfRenderedComponents = 0;
+// Joins the geometry bins back to front with a stable counting sort, equal
+// keys keep submission order. The ordering table scatters every triangle from
+// its bin straight to its bucket's range. Radix sorting first orders indices
+// by the low 16 bits of the keys, then scatters by the high 16 bits.
+void Engine::joinSorted(std::vector<Triangle> &out)
+{
+  size_t n = 0;
+  for (size_t j = 0; j < geometryJobs.size(); j++)
+    n += geometryBins[j].size();
+  out.resize(n);
 
-  if (components.components.empty()) {
+  // counts[d + 1] = keys with digit d, turned into each digit's first output slot
+  auto countDigits = [&](int shift, uint32_t mask, uint32_t buckets)
+  {
+    sortCounts.assign(buckets + 1, 0);
+    for (size_t j = 0; j < geometryJobs.size(); j++)
+      for (uint32_t key : geometryKeys[j])
+        sortCounts[((key >> shift) & mask) + 1]++;
+    for (uint32_t d = 0; d < buckets; d++)
+      sortCounts[d + 1] += sortCounts[d];
+  };
+
+  if (geometrySettings.sortMethod == SortMethod::orderingTable)
+  {
+    countDigits(0, 0xFFFFFFFF, geometrySettings.orderingTableSize);
+    for (size_t j = 0; j < geometryJobs.size(); j++)
+    {
+      const std::vector<Triangle> &bin = geometryBins[j];
+      const std::vector<uint32_t> &keys = geometryKeys[j];
+      for (size_t k = 0; k < bin.size(); k++)
+        out[sortCounts[keys[k]]++] = bin[k];
+    }
     return;
   }
 
-  for (int i = 0; i < components.components.size(); i++)
+  sortKeys.clear();
+  sortSources.clear();
+  for (size_t j = 0; j < geometryJobs.size(); j++)
   {
-    Component &component = components.components[i];
-    if (component.meshes.meshes.empty()) {
-      continue;
-    }
+    sortKeys.insert(sortKeys.end(), geometryKeys[j].begin(), geometryKeys[j].end());
+    for (const Triangle &t : geometryBins[j])
+      sortSources.push_back(&t);
+  }
+
+  countDigits(0, 0xFFFF, 0x10000);
+  sortOrder.resize(n);
+  for (size_t i = 0; i < n; i++)
+    sortOrder[sortCounts[sortKeys[i] & 0xFFFF]++] = static_cast<uint32_t>(i);
 
-    matTrans = Matrix_MakeTranslation(component.transform.pos);
-    component.transform.setupMatrix(matTrans);
+  countDigits(16, 0xFFFF, 0x10000);
+  for (uint32_t i : sortOrder)
+    out[sortCounts[sortKeys[i] >> 16]++] = *sortSources[i];
+}
 
-    for (auto &mesh : component.meshes.meshes)
+// Rasterizes the occluders' front faces at the level of detail they are drawn
+// with into the occlusion buffer, then hides every other visible mesh whose
+// screen box lies behind them. Occluders are the meshes of components marked
+// as such plus the largest ones on screen, MAX_OCCLUDERS at most.
+void Engine::cullOccluded()
+{
+  float screenArea = static_cast<float>(width) * height;
+  auto area = [](const VisibleMesh &vm)
+  { return (vm.bounds.maxX - vm.bounds.minX) * (vm.bounds.maxY - vm.bounds.minY); };
+
+  occluders.clear();
+  for (size_t i = 0; i < visibleMeshes.size(); i++)
+  {
+    const VisibleMesh &vm = visibleMeshes[i];
+    if (vm.markedOccluder || !vm.projected || area(vm) >= OCCLUDER_MIN_AREA * screenArea)
+      occluders.push_back(i);
+  }
+  // marked occluders first, then the ones reaching past the near plane, then by area
+  auto rank = [&](size_t i)
+  {
+    const VisibleMesh &vm = visibleMeshes[i];
+    if (vm.markedOccluder)
+      return 1e30f;
+    return vm.projected ? area(vm) : 1e29f;
+  };
+  std::stable_sort(occluders.begin(), occluders.end(), [&](size_t a, size_t b)
+                   { return rank(a) > rank(b); });
+  if (occluders.size() > MAX_OCCLUDERS)
+    occluders.resize(MAX_OCCLUDERS);
+  if (occluders.empty())
+    return;
+  for (size_t o : occluders)
+    visibleMeshes[o].occluder = true;
+
+  occlusionBuffer.clear();
+  float sx = 0.5f * width;
+  float sy = 0.5f * height;
+
+  for (size_t o : occluders)
+  {
+    const VisibleMesh &vm = visibleMeshes[o];
+    MeshView mv = vm.lod->view();
+    size_t count = vm.lod->vertexCount();
+    if (occluderVertices.size() < count)
+    {
+      occluderVertices.resize(count);
+      occluderW.resize(count);
+    }
+    TransformPositions(meshTransforms[vm.transform].worldViewProj, mv.x, mv.y, mv.z, count,
+                       occluderVertices.x.data(), occluderVertices.y.data(), occluderVertices.z.data(), occluderW.data());
+
+    // to screen pixels, w becomes 1/z as in the depth buffer and
+    // negative for vertices past the near plane
+    for (size_t v = 0; v < count; v++)
     {
-      if (mesh.tris.empty()) {
+      float w = occluderW[v];
+      if (w < 1.0f)
+      {
+        occluderW[v] = -1.0f;
         continue;
       }
+      occluderVertices.x[v] = (occluderVertices.x[v] / w + 1.0f) * sx;
+      occluderVertices.y[v] = (occluderVertices.y[v] / w + 1.0f) * sy;
+      occluderW[v] = 1.0f / w;
+    }
 
-      bool r = checkIfAABBisOnScreen(mesh.aabb, component.transform.matWorld, matView);
-      if (r == false) {
-        continue;
+    for (size_t k = 0; k < vm.lod->triangleCount(); k++)
+    {
+      const uint32_t *idx = &mv.indices[k * 3];
+      float x[3], y[3], w[3];
+      bool nearClipped = false;
+      for (int i = 0; i < 3; i++)
+      {
+        nearClipped |= occluderW[idx[i]] < 0.0f;
+        x[i] = occluderVertices.x[idx[i]];
+        y[i] = occluderVertices.y[idx[i]];
+        w[i] = occluderW[idx[i]];
       }
+      // only whole triangles in front of the near plane and nearer than clipEnd occlude
+      if (nearClipped || (w[0] + w[1] + w[2]) / 3.0f < clipEnd)
+        continue;
+      // same facing as the view space cull in assembleTriangles()
+      if ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) >= 0.0f)
+        continue;
+      occlusionBuffer.drawTriangle(x, y, w);
+    }
+  }
+
+  occlusionBuffer.buildPyramid();
+
+  for (VisibleMesh &vm : visibleMeshes)
+  {
+    if (vm.occluder || !vm.projected)
+      continue;
+
+    int x0 = static_cast<int>(std::floor(vm.bounds.minX)) / OCCLUSION_SCALE;
+    int y0 = static_cast<int>(std::floor(vm.bounds.minY)) / OCCLUSION_SCALE;
+    int x1 = static_cast<int>(std::floor(vm.bounds.maxX)) / OCCLUSION_SCALE + 1;
+    int y1 = static_cast<int>(std::floor(vm.bounds.maxY)) / OCCLUSION_SCALE + 1;
+    vm.visible = !occlusionBuffer.isOccluded(x0, y0, x1, y1, vm.bounds.nearestW);
+  }
+}
+
+// Transforms one chunk of mesh vertices to view space and clip space. In fixed
+// point mode clip space is 16.16 and view space is only used for lighting.
+void Engine::transformVertices(const GeometryJob &job)
+{
+  const MeshTransform &mt = meshTransforms[job.transform];
+  MeshView in = job.lod->view();
+  size_t count = job.last - job.first;
+  size_t first = job.first;
+  size_t out = job.vertexBase + job.first;
+
+  TransformPositions(mt.worldView, in.x + first, in.y + first, in.z + first, count,
+                     &viewVertices.x[out], &viewVertices.y[out], &viewVertices.z[out], nullptr);
+  if (geometrySettings.fixedPoint)
+  {
+    TransformPositionsFixed(mt.worldViewProj, in.x + first, in.y + first, in.z + first, count,
+                            &fixedClipVertices.x[out], &fixedClipVertices.y[out], &fixedClipVertices.w[out]);
+    return;
+  }
+  TransformPositions(mt.worldViewProj, in.x + first, in.y + first, in.z + first, count,
+                     &clipVertices.x[out], &clipVertices.y[out], &clipVertices.z[out], &clipW[out]);
+}
+
+// Assembles one chunk of mesh triangles from transformed vertices, then culls,
+// lights, near clips and projects them. Triangles fully in front of the near
+// plane reuse the clip space vertices, the others are clipped in view space.
+// Runs on the worker pool, so it only reads shared state and writes 'out'.
+void Engine::assembleTriangles(const GeometryJob &job, Vec3 &lightView, std::vector<Triangle> &out)
+{
+  const Mesh &mesh = *job.mesh;
+  MeshView mv = job.lod->view();
+  size_t base = job.vertexBase;
+
+  auto project = [&](Triangle &triProjected, float dp)
+  {
+    triProjected.t[0].w = 1.0f / triProjected.p[0].w;
+    triProjected.t[1].w = 1.0f / triProjected.p[1].w;
+    triProjected.t[2].w = 1.0f / triProjected.p[2].w;
+
+    float w = (triProjected.t[0].w + triProjected.t[1].w + triProjected.t[2].w) / 3.0f;
+    if (w < clipEnd) {
+      return;
+    }
+
+    triProjected.p[0] = Vector_Div(triProjected.p[0], triProjected.p[0].w);
+    triProjected.p[1] = Vector_Div(triProjected.p[1], triProjected.p[1].w);
+    triProjected.p[2] = Vector_Div(triProjected.p[2], triProjected.p[2].w);
+
+    Vec3 vOffsetView = {1, 1, 0};
+    triProjected.p[0] = Vector_Add(triProjected.p[0], vOffsetView);
+    triProjected.p[1] = Vector_Add(triProjected.p[1], vOffsetView);
+    triProjected.p[2] = Vector_Add(triProjected.p[2], vOffsetView);
+
+    for (int i = 0; i < 3; i++)
+    {
+      triProjected.p[i].x *= 0.5f * (float)width;
+      triProjected.p[i].y *= 0.5f * (float)height;
+    }
+
+    uint8_t litR = clamp2((dp * triProjected.color.r), 0.0f, 255.0f);
+    uint8_t litG = clamp2((dp * triProjected.color.g), 0.0f, 255.0f);
+    uint8_t litB = clamp2((dp * triProjected.color.b), 0.0f, 255.0f);
+    triProjected.color = {litR, litG, litB};
 
-      numOfRenderedComponents++;
+    out.push_back(triProjected);
+  };
+
+  for (size_t k = job.first; k < job.last; k++)
+  {
+    const uint32_t *idx = &mv.indices[k * 3];
+    Triangle triProjected, triViewed;
+
+    triViewed.p[0] = viewVertices.at(base + idx[0]);
+    triViewed.p[1] = viewVertices.at(base + idx[1]);
+    triViewed.p[2] = viewVertices.at(base + idx[2]);
+
+    Vec3 normal, line1, line2;
+    line1 = Vector_Sub(triViewed.p[1], triViewed.p[0]);
+    line2 = Vector_Sub(triViewed.p[2], triViewed.p[0]);
+    normal = Vector_CrossProduct(line1, line2);
+    normal = Vector_Normalise(normal);
+
+    // the camera sits at the origin of view space
+    if (Vector_DotProduct(normal, triViewed.p[0]) >= 0.0f)
+      continue;
+
+    float dp = max(0.1f, Vector_DotProduct(lightView, normal));
 
-      for (auto &tri : mesh.tris)
+    triViewed.color = mesh.color;
+    triViewed.textureID = mesh.textureID;
+    triViewed.t[0] = mv.uvs[idx[0]];
+    triViewed.t[1] = mv.uvs[idx[1]];
+    triViewed.t[2] = mv.uvs[idx[2]];
+
+    // same inside test as Triangle_CLipAgainstPlane against the z = 1 plane
+    if (triViewed.p[0].z >= 1.0f && triViewed.p[1].z >= 1.0f && triViewed.p[2].z >= 1.0f)
+    {
+      triProjected = triViewed;
+      for (int i = 0; i < 3; i++)
       {
-        Triangle triProjected, triTransformed, triViewed;
-
-        triTransformed.p[0] = Matrix_MultiplyVector(component.transform.matWorld, tri.p[0]);
-        triTransformed.p[1] = Matrix_MultiplyVector(component.transform.matWorld, tri.p[1]);
-        triTransformed.p[2] = Matrix_MultiplyVector(component.transform.matWorld, tri.p[2]);
-        
-        triTransformed.t[0] = tri.t[0];
-        triTransformed.t[1] = tri.t[1];
-        triTransformed.t[2] = tri.t[2];
-        triTransformed.textureID = mesh.textureID;
-        triTransformed.color = tri.color;
-
-        Vec3 normal, line1, line2;
-        line1 = Vector_Sub(triTransformed.p[1], triTransformed.p[0]);
-        line2 = Vector_Sub(triTransformed.p[2], triTransformed.p[0]);
-        normal = Vector_CrossProduct(line1, line2);
-        normal = Vector_Normalise(normal);
-
-        Vec3 vCameraRay = Vector_Sub(triTransformed.p[0], camera);
-
-        if (Vector_DotProduct(normal, vCameraRay) < 0.0f)
-        {
-          Vec3 light_direction = {1, -1, -1};
-          light_direction = Vector_Normalise(light_direction);
-          float dp = max(0.1f, Vector_DotProduct(light_direction, normal));
-
-          triViewed.p[0] = Matrix_MultiplyVector(matView, triTransformed.p[0]);
-          triViewed.p[1] = Matrix_MultiplyVector(matView, triTransformed.p[1]);
-          triViewed.p[2] = Matrix_MultiplyVector(matView, triTransformed.p[2]);
-          triViewed.color = tri.color;
-          triViewed.textureID = tri.textureID;
-          triViewed.t[0] = triTransformed.t[0];
-          triViewed.t[1] = triTransformed.t[1];
-          triViewed.t[2] = triTransformed.t[2];
-
-          int nClippedTriangles = 0;
-          Triangle clipped[2];
-          Vec3 av = {0, 0, 1};
-          Vec3 bc = {0, 0, 1};
-          nClippedTriangles = Triangle_CLipAgainstPlane(av, bc, triViewed, clipped[0], clipped[1]);
-
-          for (int n = 0; n < nClippedTriangles; n++)
-          {
-            triProjected.p[0] = Matrix_MultiplyVector(matProj, clipped[n].p[0]);
-            triProjected.p[1] = Matrix_MultiplyVector(matProj, clipped[n].p[1]);
-            triProjected.p[2] = Matrix_MultiplyVector(matProj, clipped[n].p[2]);
-            triProjected.color = clipped[n].color;
-            triProjected.textureID = clipped[n].textureID;
-            triProjected.t[0] = clipped[n].t[0];
-            triProjected.t[1] = clipped[n].t[1];
-            triProjected.t[2] = clipped[n].t[2];
-
-            triProjected.t[0].w = 1.0f / triProjected.p[0].w;
-            triProjected.t[1].w = 1.0f / triProjected.p[1].w;
-            triProjected.t[2].w = 1.0f / triProjected.p[2].w;
-
-            float w = (triProjected.t[0].w + triProjected.t[1].w + triProjected.t[2].w) / 3.0f;
-            if (w < clipEnd) {
-              continue;
-            }
+        uint32_t v = base + idx[i];
+        triProjected.p[i] = {clipVertices.x[v], clipVertices.y[v], clipVertices.z[v], clipW[v]};
+      }
+      project(triProjected, dp);
+      continue;
+    }
 
-            triProjected.p[0] = Vector_Div(triProjected.p[0], triProjected.p[0].w);
-            triProjected.p[1] = Vector_Div(triProjected.p[1], triProjected.p[1].w);
-            triProjected.p[2] = Vector_Div(triProjected.p[2], triProjected.p[2].w);
+    int nClippedTriangles = 0;
+    Triangle clipped[2];
+    Vec3 av = {0, 0, 1};
+    Vec3 bc = {0, 0, 1};
+    nClippedTriangles = Triangle_CLipAgainstPlane(av, bc, triViewed, clipped[0], clipped[1]);
 
-            Vec3 vOffsetView = {1, 1, 0};
-            triProjected.p[0] = Vector_Add(triProjected.p[0], vOffsetView);
-            triProjected.p[1] = Vector_Add(triProjected.p[1], vOffsetView);
-            triProjected.p[2] = Vector_Add(triProjected.p[2], vOffsetView);
+    for (int n = 0; n < nClippedTriangles; n++)
+    {
+      triProjected.p[0] = Matrix_MultiplyVector(matProj, clipped[n].p[0]);
+      triProjected.p[1] = Matrix_MultiplyVector(matProj, clipped[n].p[1]);
+      triProjected.p[2] = Matrix_MultiplyVector(matProj, clipped[n].p[2]);
+      triProjected.color = clipped[n].color;
+      triProjected.textureID = clipped[n].textureID;
+      triProjected.t[0] = clipped[n].t[0];
+      triProjected.t[1] = clipped[n].t[1];
+      triProjected.t[2] = clipped[n].t[2];
+      project(triProjected, dp);
+    }
+  }
+}
 
-            for (int i = 0; i < 3; i++)
-            {
-              triProjected.p[i].x *= 0.5f * (float)width;
-              triProjected.p[i].y *= 0.5f * (float)height;
-            }
+void Engine::clipAgainstScreen(Triangle &triToRaster, std::list<Triangle> &listTriangles)
+{
+  Triangle clipped[2];
+  listTriangles.push_back(triToRaster);
+  int nNewTriangles = 1;
 
-            uint8_t litR = clamp2((dp * triProjected.color.r), 0.0f, 255.0f);
-            uint8_t litG = clamp2((dp * triProjected.color.g), 0.0f, 255.0f);
-            uint8_t litB = clamp2((dp * triProjected.color.b), 0.0f, 255.0f);
-            triProjected.color = {litR, litG, litB};
+  for (int p = 0; p < 4; p++)
+  {
+    int nTrisToAdd = 0;
+    while (nNewTriangles > 0)
+    {
+      Triangle test = listTriangles.front();
+      listTriangles.pop_front();
+      nNewTriangles--;
 
-            vecTrianglesToRaster.push_back(triProjected);
-          }
-        }
+      Vec3 av;
+      Vec3 bv;
+
+      switch (p)
+      {
+      case 0:
+        av = {0, 0, 0};
+        bv = {0, 1, 0};
+        nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
+        break;
+      case 1:
+        av = {0, (float)height - 1, 0};
+        bv = {0, -1, 0};
+        nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
+        break;
+      case 2:
+        av = {0, 0, 0};
+        bv = {1, 0, 0};
+        nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
+        break;
+      case 3:
+        av = {(float)width - 1, 0, 0};
+        bv = {-1, 0, 0};
+        nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
+        break;
+      }
+
+      for (int w = 0; w < nTrisToAdd; w++)
+      {
+        listTriangles.push_back(clipped[w]);
       }
     }
+    nNewTriangles = listTriangles.size();
+  }
+}
+
+// Screen clips 'tri' into out (MAX_CLIPPED_TRIANGLES entries), returns the count.
+// With the guard band on, triangles inside the band are passed through and
+// clamped by the rasterizers, the rest go through the allocation-free clipper.
+// The fixed point geometry stage already clipped its triangles to the band.
+int Engine::clipForRaster(Triangle &tri, Triangle *out)
+{
+  if (useGuardBand || useFixedPoint)
+  {
+    float minX = std::min({tri.p[0].x, tri.p[1].x, tri.p[2].x});
+    float maxX = std::max({tri.p[0].x, tri.p[1].x, tri.p[2].x});
+    float minY = std::min({tri.p[0].y, tri.p[1].y, tri.p[2].y});
+    float maxY = std::max({tri.p[0].y, tri.p[1].y, tri.p[2].y});
+
+    if (maxX < 0 || maxY < 0 || minX > width - 1 || minY > height - 1)
+      return 0;
+
+    if (minX >= -GUARD_BAND && maxX <= width + GUARD_BAND &&
+        minY >= -GUARD_BAND && maxY <= height + GUARD_BAND)
+    {
+      out[0] = tri;
+      return 1;
+    }
+
+    return Triangle_ClipAgainstRect(tri, 0, 0, (float)width - 1, (float)height - 1, out);
   }
 
-  if (useSort)
+  std::list<Triangle> listTriangles;
+  clipAgainstScreen(tri, listTriangles);
+
+  int n = 0;
+  for (auto &t : listTriangles)
   {
-    sort(vecTrianglesToRaster.begin(), vecTrianglesToRaster.end(), [](Triangle &t1, Triangle &t2)
-         {
-           float z1 = (t1.p[0].z + t1.p[1].z + t1.p[2].z) / 3.0f;
-           float z2 = (t2.p[0].z + t2.p[1].z + t2.p[2].z) / 3.0f;
-           return z1 > z2; });
+    if (n < MAX_CLIPPED_TRIANGLES)
+      out[n++] = t;
   }
+  return n;
 }
 
 void Engine::rasterize()
@@ -1007,65 +1773,86 @@ void Engine::rasterize()
     return;
   }
 
+  if (useTiles) {
+    rasterizeTiled();
+    return;
+  }
+
+  Triangle clipped[MAX_CLIPPED_TRIANGLES];
+
   for (auto &triToRaster : vecTrianglesToRaster)
   {
-    Triangle clipped[2];
-    std::list<Triangle> listTriangles;
-    listTriangles.push_back(triToRaster);
-    int nNewTriangles = 1;
+    int nClipped = clipForRaster(triToRaster, clipped);
 
-    for (int p = 0; p < 4; p++)
+    for (int n = 0; n < nClipped; n++)
     {
-      int nTrisToAdd = 0;
-      while (nNewTriangles > 0)
-      {
-        Triangle test = listTriangles.front();
-        listTriangles.pop_front();
-        nNewTriangles--;
+      Triangle &t = clipped[n];
+      stData.numOfTrianglesPerSecond++;
 
-        Vec3 av;
-        Vec3 bv;
+      // the same bounds the tiled path bins by, no pixel outside is drawn
+      ScreenRect r = triangleBounds(t);
+      if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        continue;
+      prepareTiles(r);
+      try {
+        renderTriangle(t, t.textureID, r);
+      } catch (const std::exception& e) {
+      }
+    }
+  }
+}
 
-        switch (p)
-        {
-        case 0:
-          av = {0, 0, 0};
-          bv = {0, 1, 0};
-          nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
-          break;
-        case 1:
-          av = {0, (float)height - 1, 0};
-          bv = {0, -1, 0};
-          nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
-          break;
-        case 2:
-          av = {0, 0, 0};
-          bv = {1, 0, 0};
-          nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
-          break;
-        case 3:
-          av = {(float)width - 1, 0, 0};
-          bv = {-1, 0, 0};
-          nTrisToAdd = Triangle_CLipAgainstPlane(av, bv, test, clipped[0], clipped[1]);
-          break;
-        }
+void Engine::rasterizeTiled()
+{
+  vecTrianglesClipped.clear();
+  for (auto &bin : tileBins)
+  {
+    bin.clear();
+  }
 
-        for (int w = 0; w < nTrisToAdd; w++)
-        {
-          listTriangles.push_back(clipped[w]);
-        }
-      }
-      nNewTriangles = listTriangles.size();
+  Triangle clipped[MAX_CLIPPED_TRIANGLES];
+
+  for (auto &triToRaster : vecTrianglesToRaster)
+  {
+    int nClipped = clipForRaster(triToRaster, clipped);
+
+    for (int n = 0; n < nClipped; n++)
+    {
+      Triangle &t = clipped[n];
+      ScreenRect r = triangleBounds(t);
+      if (r.x0 >= r.x1 || r.y0 >= r.y1)
+        continue;
+
+      uint32_t index = vecTrianglesClipped.size();
+      vecTrianglesClipped.push_back(t);
+
+      for (int ty = r.y0 / TILE_SIZE; ty <= (r.y1 - 1) / TILE_SIZE; ty++)
+        for (int tx = r.x0 / TILE_SIZE; tx <= (r.x1 - 1) / TILE_SIZE; tx++)
+          tileBins[ty * tilesX + tx].push_back(index);
     }
+  }
 
-    for (auto &t : listTriangles)
+  stData.numOfTrianglesPerSecond += vecTrianglesClipped.size();
+
+  // every tile owns its pixels of videoBuffer and pDepthBuffer, no locking needed
+  workers.parallelFor(tileBins.size(), [this](size_t tile)
+                      {
+    int tx = tile % tilesX;
+    int ty = tile / tilesX;
+    ScreenRect clip = {tx * TILE_SIZE, ty * TILE_SIZE,
+                       std::min((tx + 1) * TILE_SIZE, width),
+                       std::min((ty + 1) * TILE_SIZE, height)};
+    if (!tileBins[tile].empty())
+      prepareTile(tile);
+
+    for (uint32_t index : tileBins[tile])
     {
+      Triangle &t = vecTrianglesClipped[index];
       try {
-        renderTriangle(t, t.textureID);
+        renderTriangle(t, t.textureID, clip);
       } catch (const std::exception& e) {
       }
-    }
-  }
+    } });
 }
 
 void Engine::setSort(bool b)
@@ -1073,25 +1860,93 @@ void Engine::setSort(bool b)
   useSort = b;
 }
 
+void Engine::setPipelined(bool v)
+{
+  usePipeline = v;
+}
+
+uint64_t Engine::getSubmittedFrame() const
+{
+  return submittedFrame;
+}
+
+uint64_t Engine::getDisplayedFrame() const
+{
+  return displayedFrame;
+}
+
+void Engine::setSortMethod(SortMethod method, int orderingTableSize)
+{
+  sortMethod = method;
+  this->orderingTableSize = std::max(1, std::min(orderingTableSize, 65536));
+}
+
 void Engine::setDither(bool v)
 {
   useDither = v;
 }
 
+void Engine::setDitherMode(DitherMode mode)
+{
+  ditherMode = mode;
+}
+
+void Engine::setTiledRaster(bool v)
+{
+  useTiles = v;
+}
+
+void Engine::setGuardBand(bool v)
+{
+  useGuardBand = v;
+}
+
+void Engine::setFixedPoint(bool v)
+{
+  useFixedPoint = v;
+}
+
+void Engine::setTextureMapping(TextureMapping mode, int spanLength)
+{
+  textureMapping = mode;
+  spanSubdivision = std::max(1, spanLength);
+}
+
+void Engine::setMipmapping(bool v)
+{
+  useMipmaps = v;
+}
+
+void Engine::setLodBias(float bias)
+{
+  lodBias = bias;
+}
+
+void Engine::setOcclusionCulling(bool v)
+{
+  useOcclusion = v;
+}
+
+void Engine::setColorClear(bool v)
+{
+  useColorClear = v;
+  // tiles drawn while it was off are not tracked
+  if (v)
+    clearAllColor = true;
+}
+
+void Engine::setRasterKernel(RasterKernel kernel)
+{
+  rasterKernel = kernel;
+}
+
 void Engine::setFogColor(const Color& new_color)
 {
   this->fogColor = new_color;
   // Re-initialize clearScreenPtr with the new fog color
   if (clearScreenPtr) { // Ensure it was allocated
-    for (int y = 0; y < height; y++)
-    {
-      for (int x = 0; x < width; x++)
-      {
-        int i = (y * width + x) * 3;
-        clearScreenPtr[i] = this->fogColor.r;
-        clearScreenPtr[i + 1] = this->fogColor.g;
-        clearScreenPtr[i + 2] = this->fogColor.b;
-      }
-    }
+    uint32_t pixel = packPixel(fogColor.r, fogColor.g, fogColor.b);
+    std::fill_n(reinterpret_cast<uint32_t *>(clearScreenPtr), (size_t)width * height, pixel);
   }
+  clearAllColor = true;
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "engine.hpp"
+#include "fixed.hpp"
+
+/*
+  Triangle assembly for the fixed point mode, the integer counterpart of
+  assembleTriangles(). Vertices come from TransformPositionsFixed() as 16.16
+  clip space x, y and w. Near clipping, the perspective divide, snapping to
+  12.4, back face culling and guard band clipping are all integer, so the
+  triangles handed to the rasterizer only depend on the rounded inputs.
+  Matrices are still built in float, and lighting is still float: it only
+  picks the triangle's colour.
+
+  The rasterizer takes floats, so results are stored as floats that hold the
+  integers exactly: 12.4 positions, and 16.16 u/v and 1/w.
+*/
+
+namespace
+{
+  // clip space position and u/v, all 16.16
+  struct ClipVertex
+  {
+    int64_t x, y, w, u, v;
+  };
+
+  // 12.4 screen position, 16.16 u/v and 1/w
+  struct ScreenVertex
+  {
+    int64_t x, y, u, v, iw;
+  };
+
+  constexpr int T_SHIFT = 30;
+
+  // dIn / (dIn - dOut) in 2.30, for dIn >= 0 > dOut
+  inline int64_t clipFraction(int64_t dIn, int64_t dOut)
+  {
+    return (dIn << T_SHIFT) / (dIn - dOut);
+  }
+
+  inline int64_t lerp(int64_t a, int64_t b, int64_t t)
+  {
+    return a + (((b - a) * t) >> T_SHIFT);
+  }
+
+  // n / d rounded to nearest, d > 0
+  inline int64_t divRound(int64_t n, int64_t d)
+  {
+    return n >= 0 ? (n + d / 2) / d : -((-n + d / 2) / d);
+  }
+
+  // One Sutherland-Hodgman pass, 'dist' is positive inside. Always
+  // interpolates from the inside vertex so shared edges clip identically.
+  template <typename Vertex, typename Dist, typename Intersect>
+  int clipPolygon(const Vertex *in, int nIn, Vertex *out, Dist dist, Intersect intersect)
+  {
+    int nOut = 0;
+    for (int i = 0; i < nIn; i++)
+    {
+      const Vertex &a = in[i];
+      const Vertex &b = in[(i + 1) % nIn];
+      int64_t da = dist(a);
+      int64_t db = dist(b);
+
+      if (da >= 0)
+        out[nOut++] = a;
+      if ((da >= 0) != (db >= 0))
+        out[nOut++] = da >= 0 ? intersect(a, b, da, db) : intersect(b, a, db, da);
+    }
+    return nOut;
+  }
+}
+
+void Engine::assembleTrianglesFixed(const GeometryJob &job, Vec3 &lightView, std::vector<Triangle> &out)
+{
+  const Mesh &mesh = *job.mesh;
+  MeshView mv = job.lod->view();
+  size_t base = job.vertexBase;
+
+  const int64_t halfWidth = (int64_t)width * SUBPIXEL_ONE / 2;
+  const int64_t halfHeight = (int64_t)height * SUBPIXEL_ONE / 2;
+  // triangles whose average 1/w is below clipEnd are dropped
+  const int64_t clipEndSum = 3 * saturateFixed16(clipEnd, INT32_MAX);
+
+  // 12.4 guard band, triangles inside it go to the rasterizer unclipped and
+  // the others are clipped to the same rect as clipForRaster() clips to
+  const int64_t bandX0 = -GUARD_BAND * SUBPIXEL_ONE;
+  const int64_t bandY0 = -GUARD_BAND * SUBPIXEL_ONE;
+  const int64_t bandX1 = ((int64_t)width + GUARD_BAND) * SUBPIXEL_ONE;
+  const int64_t bandY1 = ((int64_t)height + GUARD_BAND) * SUBPIXEL_ONE;
+  const int64_t rectX0 = (int64_t)rasterRect.x0 * SUBPIXEL_ONE;
+  const int64_t rectY0 = (int64_t)rasterRect.y0 * SUBPIXEL_ONE;
+  const int64_t rectX1 = (int64_t)rasterRect.x1 * SUBPIXEL_ONE;
+  const int64_t rectY1 = (int64_t)rasterRect.y1 * SUBPIXEL_ONE;
+
+  auto nearIntersect = [](const ClipVertex &in, const ClipVertex &outside, int64_t dIn, int64_t dOut)
+  {
+    int64_t t = clipFraction(dIn, dOut);
+    return ClipVertex{lerp(in.x, outside.x, t), lerp(in.y, outside.y, t), FIXED_ONE,
+                      lerp(in.u, outside.u, t), lerp(in.v, outside.v, t)};
+  };
+
+  auto screenIntersect = [](const ScreenVertex &in, const ScreenVertex &outside, int64_t dIn, int64_t dOut)
+  {
+    int64_t t = clipFraction(dIn, dOut);
+    return ScreenVertex{lerp(in.x, outside.x, t), lerp(in.y, outside.y, t),
+                        lerp(in.u, outside.u, t), lerp(in.v, outside.v, t), lerp(in.iw, outside.iw, t)};
+  };
+
+  auto emit = [&](const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c, Triangle &tri)
+  {
+    const ScreenVertex *v[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++)
+    {
+      tri.p[i] = {static_cast<float>(v[i]->x) * (1.0f / SUBPIXEL_ONE), static_cast<float>(v[i]->y) * (1.0f / SUBPIXEL_ONE), 0.0f, 1.0f};
+      tri.t[i] = {static_cast<float>(v[i]->u) * (1.0f / FIXED_ONE), static_cast<float>(v[i]->v) * (1.0f / FIXED_ONE),
+                  static_cast<float>(v[i]->iw) * (1.0f / FIXED_ONE)};
+    }
+    out.push_back(tri);
+  };
+
+  for (size_t k = job.first; k < job.last; k++)
+  {
+    const uint32_t *idx = &mv.indices[k * 3];
+
+    ClipVertex clip[4], nearClipped[4];
+    ClipVertex *poly = clip;
+    int n = 3;
+    bool crossesNear = false;
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t v = base + idx[i];
+      clip[i] = {fixedClipVertices.x[v], fixedClipVertices.y[v], fixedClipVertices.w[v],
+                 saturateFixed16(mv.uvs[idx[i]].u, INT32_MAX), saturateFixed16(mv.uvs[idx[i]].v, INT32_MAX)};
+      crossesNear |= clip[i].w < FIXED_ONE;
+    }
+
+    // w is view space z, so this is the z = 1 near plane of assembleTriangles()
+    if (crossesNear)
+    {
+      n = clipPolygon(clip, 3, nearClipped, [](const ClipVertex &c) { return c.w - FIXED_ONE; }, nearIntersect);
+      poly = nearClipped;
+    }
+    if (n < 3)
+      continue;
+
+    ScreenVertex screen[4];
+    for (int i = 0; i < n; i++)
+    {
+      screen[i].x = divRound(poly[i].x * halfWidth, poly[i].w) + halfWidth;
+      screen[i].y = divRound(poly[i].y * halfHeight, poly[i].w) + halfHeight;
+      screen[i].u = poly[i].u;
+      screen[i].v = poly[i].v;
+      screen[i].iw = divRound(int64_t(1) << (2 * FIXED_SHIFT), poly[i].w);
+    }
+
+    // back faces (and edge-on ones) wind the other way on screen, like the
+    // view space cull of assembleTriangles()
+    int64_t area = 0;
+    for (int i = 0; i < n; i++)
+    {
+      const ScreenVertex &a = screen[i];
+      const ScreenVertex &b = screen[(i + 1) % n];
+      area += a.x * b.y - b.x * a.y;
+    }
+    if (area >= 0)
+      continue;
+
+    Vec3 p0 = viewVertices.at(base + idx[0]);
+    Vec3 p1 = viewVertices.at(base + idx[1]);
+    Vec3 p2 = viewVertices.at(base + idx[2]);
+    Vec3 line1 = Vector_Sub(p1, p0);
+    Vec3 line2 = Vector_Sub(p2, p0);
+    Vec3 normal = Vector_CrossProduct(line1, line2);
+    normal = Vector_Normalise(normal);
+    float dp = max(0.1f, Vector_DotProduct(lightView, normal));
+
+    uint8_t litR = clamp2((dp * mesh.color.r), 0.0f, 255.0f);
+    uint8_t litG = clamp2((dp * mesh.color.g), 0.0f, 255.0f);
+    uint8_t litB = clamp2((dp * mesh.color.b), 0.0f, 255.0f);
+
+    Triangle tri;
+    tri.color = {litR, litG, litB};
+    tri.textureID = mesh.textureID;
+
+    for (int i = 1; i + 1 < n; i++)
+    {
+      const ScreenVertex &a = screen[0];
+      const ScreenVertex &b = screen[i];
+      const ScreenVertex &c = screen[i + 1];
+
+      if (a.iw + b.iw + c.iw < clipEndSum)
+        continue;
+
+      int64_t minX = std::min({a.x, b.x, c.x}), maxX = std::max({a.x, b.x, c.x});
+      int64_t minY = std::min({a.y, b.y, c.y}), maxY = std::max({a.y, b.y, c.y});
+      if (maxX < rectX0 || maxY < rectY0 || minX > rectX1 || minY > rectY1)
+        continue;
+
+      if (minX >= bandX0 && maxX <= bandX1 && minY >= bandY0 && maxY <= bandY1)
+      {
+        emit(a, b, c, tri);
+        continue;
+      }
+
+      // every plane adds at most one vertex, 3 + 4 planes
+      ScreenVertex bufferA[8] = {a, b, c};
+      ScreenVertex bufferB[8];
+      int m = 3;
+      m = clipPolygon(bufferA, m, bufferB, [&](const ScreenVertex &s) { return s.y - rectY0; }, screenIntersect);
+      m = clipPolygon(bufferB, m, bufferA, [&](const ScreenVertex &s) { return rectY1 - s.y; }, screenIntersect);
+      m = clipPolygon(bufferA, m, bufferB, [&](const ScreenVertex &s) { return s.x - rectX0; }, screenIntersect);
+      m = clipPolygon(bufferB, m, bufferA, [&](const ScreenVertex &s) { return rectX1 - s.x; }, screenIntersect);
+
+      for (int j = 1; j + 1 < m; j++)
+        emit(bufferA[0], bufferA[j], bufferA[j + 1], tri);
+    }
+  }
+}
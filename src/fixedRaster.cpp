@@ -0,0 +1,152 @@
+#include "engine.hpp"
+#include "fixed.hpp"
+
+/*
+  Integer textured triangle kernel for the fixed point mode. Vertices arrive
+  from the fixed point geometry stage already snapped to 12.4, with u/v and
+  1/w on 16.16, so converting them back to integers here is exact.
+
+  Coverage uses the shared edge functions, so it is the same as the other
+  kernels. u/v (in texels) and w are 16.16 planes in 64 bits: gradients are
+  computed once per triangle and the inner loop only adds. Texture
+  coordinates are affine like on the PS1 GPU. Depth is the 16.16 w, stored
+  in the integer depth buffer.
+*/
+
+namespace
+{
+  // Larger coordinates or attributes could overflow the gradients. The
+  // geometry stage never makes them, float triangles left over from the
+  // frame before the mode was switched on are dropped.
+  constexpr int32_t COORDINATE_LIMIT = 1 << 20;   // 12.4, 65536 pixels
+  constexpr int64_t ATTRIBUTE_LIMIT = int64_t(1) << 34; // 16.16, 262144 texels
+
+  // gx * ox + gy * oy wrapped to 64 bits. Slivers can have huge gradients,
+  // but at pixel centers inside the triangle the true result is small, and
+  // then the wrapped one is the same.
+  inline int64_t planeOffset(int64_t gx, int64_t gy, int64_t ox, int64_t oy)
+  {
+    uint64_t s = static_cast<uint64_t>(gx) * static_cast<uint64_t>(ox) +
+                 static_cast<uint64_t>(gy) * static_cast<uint64_t>(oy);
+    return static_cast<int64_t>(s);
+  }
+}
+
+void Engine::texturedTriangleFixed(const Triangle &tri, const Texture &texture, const Color &color, const ScreenRect &clip)
+{
+  int32_t sx[3], sy[3];
+  int64_t u[3], v[3], w[3];
+  for (int i = 0; i < 3; i++)
+  {
+    if (!(fabsf(tri.p[i].x) < COORDINATE_LIMIT / SUBPIXEL_ONE && fabsf(tri.p[i].y) < COORDINATE_LIMIT / SUBPIXEL_ONE))
+      return;
+    sx[i] = toSubpixel(tri.p[i].x);
+    sy[i] = toSubpixel(tri.p[i].y);
+    if (!(fabsf(tri.t[i].u) < 32768.0f && fabsf(tri.t[i].v) < 32768.0f && fabsf(tri.t[i].w) < 32768.0f))
+      return;
+    u[i] = toFixed16Wide(tri.t[i].u) * texture.width;
+    v[i] = (FIXED_ONE - toFixed16Wide(tri.t[i].v)) * texture.height; // v flipped for texture coordinate system
+    w[i] = toFixed16Wide(tri.t[i].w);
+  }
+
+  EdgeFunction edges[3];
+  int order[3];
+  if (!triangleEdges(sx, sy, edges, order))
+    return;
+
+  // repeats of wrapping textures are dropped so u/v start in the first one
+  if (texture.pow2)
+  {
+    int64_t repeatU = (static_cast<int64_t>(texture.width) << FIXED_SHIFT) - 1;
+    int64_t repeatV = (static_cast<int64_t>(texture.height) << FIXED_SHIFT) - 1;
+    int64_t baseU = std::min({u[0], u[1], u[2]}) & ~repeatU;
+    int64_t baseV = std::min({v[0], v[1], v[2]}) & ~repeatV;
+    for (int i = 0; i < 3; i++)
+    {
+      u[i] -= baseU;
+      v[i] -= baseV;
+    }
+  }
+
+  for (int i = 0; i < 3; i++)
+  {
+    if (std::abs(u[i]) >= ATTRIBUTE_LIMIT || std::abs(v[i]) >= ATTRIBUTE_LIMIT || std::abs(w[i]) >= ATTRIBUTE_LIMIT)
+      return;
+  }
+
+  // pixels whose centers lie in the snapped bounding box
+  int xFirst = std::max(subpixelCeilCenter(std::min({sx[0], sx[1], sx[2]})), clip.x0);
+  int xLast = std::min(((std::max({sx[0], sx[1], sx[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1, clip.x1);
+  int yFirst = std::max(subpixelCeilCenter(std::min({sy[0], sy[1], sy[2]})), clip.y0);
+  int yLast = std::min(((std::max({sy[0], sy[1], sy[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1, clip.y1);
+  if (xFirst >= xLast || yFirst >= yLast)
+    return;
+
+  int64_t dx12 = sx[1] - sx[0], dy12 = sy[1] - sy[0];
+  int64_t dx13 = sx[2] - sx[0], dy13 = sy[2] - sy[0];
+  int64_t denom = dx12 * dy13 - dx13 * dy12;
+
+  // attribute change per whole pixel in x and y
+  auto gradient = [&](const int64_t a[3], int64_t &dadx, int64_t &dady)
+  {
+    int64_t da12 = a[1] - a[0], da13 = a[2] - a[0];
+    dadx = ((da12 * dy13 - da13 * dy12) * SUBPIXEL_ONE) / denom;
+    dady = ((dx12 * da13 - dx13 * da12) * SUBPIXEL_ONE) / denom;
+  };
+
+  int64_t dudx, dudy, dvdx, dvdy, dwdx, dwdy;
+  gradient(u, dudx, dudy);
+  gradient(v, dvdx, dvdy);
+  gradient(w, dwdx, dwdy);
+
+  // colour modulation and fog as 16.16 factors
+  const int32_t modR = color.r * FIXED_ONE / 255;
+  const int32_t modG = color.g * FIXED_ONE / 255;
+  const int32_t modB = color.b * FIXED_ONE / 255;
+  const int64_t fogScale = toFixed16(fogW / 0.5f);
+
+  for (int y = yFirst; y < yLast; y++)
+  {
+    int xStart = xFirst, xEnd = xLast;
+    for (int k = 0; k < 3; k++)
+      edges[k].clipSpan(y, xStart, xEnd);
+    if (xStart >= xEnd)
+      continue;
+
+    // plane equations evaluated at the first pixel center, then add-only
+    int64_t ox = ((int64_t)xStart << SUBPIXEL_SHIFT) + SUBPIXEL_ONE / 2 - sx[0];
+    int64_t oy = ((int64_t)y << SUBPIXEL_SHIFT) + SUBPIXEL_ONE / 2 - sy[0];
+    int64_t pu = u[0] + (planeOffset(dudx, dudy, ox, oy) >> SUBPIXEL_SHIFT);
+    int64_t pv = v[0] + (planeOffset(dvdx, dvdy, ox, oy) >> SUBPIXEL_SHIFT);
+    int64_t pw = w[0] + (planeOffset(dwdx, dwdy, ox, oy) >> SUBPIXEL_SHIFT);
+
+    int32_t *depthRow = &fixedDepthBuffer[(size_t)y * width];
+    uint32_t *pixel = reinterpret_cast<uint32_t *>(videoBuffer) + y * width + xStart;
+
+    for (int x = xStart; x < xEnd; x++, pixel++, pu += dudx, pv += dvdx, pw += dwdx)
+    {
+      if (pw <= 0)
+        continue;
+
+      int32_t depth = static_cast<int32_t>(std::min<int64_t>(pw, INT32_MAX));
+      if (!(depth > depthRow[x] || useSort))
+        continue;
+
+      uint32_t c = texture.fetch(static_cast<int>(pu >> FIXED_SHIFT), static_cast<int>(pv >> FIXED_SHIFT));
+
+      int32_t fog = static_cast<int32_t>(std::min<int64_t>(FIXED_ONE, (pw * fogScale) >> FIXED_SHIFT));
+      int32_t ifog = FIXED_ONE - fog;
+
+      int32_t r = ((c & 0xff) * modR) >> FIXED_SHIFT;
+      int32_t g = (((c >> 8) & 0xff) * modG) >> FIXED_SHIFT;
+      int32_t b = (((c >> 16) & 0xff) * modB) >> FIXED_SHIFT;
+
+      *pixel = packPixel(static_cast<uint8_t>((r * fog + fogColor.r * ifog) >> FIXED_SHIFT),
+                         static_cast<uint8_t>((g * fog + fogColor.g * ifog) >> FIXED_SHIFT),
+                         static_cast<uint8_t>((b * fog + fogColor.b * ifog) >> FIXED_SHIFT));
+
+      if (!useSort)
+        depthRow[x] = depth;
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#include "frustum.hpp"
+#include <immintrin.h>
+
+Frustum::Side Frustum::classify(const AABB &box) const
+{
+  float cx = (box.min.x + box.max.x) * 0.5f;
+  float cy = (box.min.y + box.max.y) * 0.5f;
+  float cz = (box.min.z + box.max.z) * 0.5f;
+  float ex = (box.max.x - box.min.x) * 0.5f;
+  float ey = (box.max.y - box.min.y) * 0.5f;
+  float ez = (box.max.z - box.min.z) * 0.5f;
+  float radius = sqrtf(ex * ex + ey * ey + ez * ez);
+
+  // bit i of each mask is set when plane i says so
+  int sphereNotInside = 0, sphereOutside = 0, boxOutside = 0, boxCrossing = 0;
+
+#ifdef __AVX__
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 a = _mm256_load_ps(nx), b = _mm256_load_ps(ny), c = _mm256_load_ps(nz);
+  __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, _mm256_set1_ps(cx)), _mm256_mul_ps(b, _mm256_set1_ps(cy))),
+                              _mm256_add_ps(_mm256_mul_ps(c, _mm256_set1_ps(cz)), _mm256_load_ps(nd)));
+  __m256 r = _mm256_set1_ps(radius);
+
+  sphereNotInside = _mm256_movemask_ps(_mm256_cmp_ps(dist, r, _CMP_LT_OQ));
+  if (!sphereNotInside)
+    return inside;
+  sphereOutside = _mm256_movemask_ps(_mm256_cmp_ps(dist, _mm256_sub_ps(zero, r), _CMP_LT_OQ));
+  if (sphereOutside)
+    return outside;
+
+  __m256 support = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(a, absMask), _mm256_set1_ps(ex)),
+                                               _mm256_mul_ps(_mm256_and_ps(b, absMask), _mm256_set1_ps(ey))),
+                                 _mm256_mul_ps(_mm256_and_ps(c, absMask), _mm256_set1_ps(ez)));
+  boxOutside = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(dist, support), zero, _CMP_LT_OQ));
+  boxCrossing = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_sub_ps(dist, support), zero, _CMP_LT_OQ));
+#else
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 zero = _mm_setzero_ps();
+  __m128 dist[2], support[2];
+  __m128 r = _mm_set1_ps(radius);
+
+  for (int h = 0; h < 2; h++)
+  {
+    __m128 a = _mm_load_ps(nx + h * 4), b = _mm_load_ps(ny + h * 4), c = _mm_load_ps(nz + h * 4);
+    dist[h] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(cx)), _mm_mul_ps(b, _mm_set1_ps(cy))),
+                         _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(cz)), _mm_load_ps(nd + h * 4)));
+    support[h] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(a, absMask), _mm_set1_ps(ex)),
+                                       _mm_mul_ps(_mm_and_ps(b, absMask), _mm_set1_ps(ey))),
+                            _mm_mul_ps(_mm_and_ps(c, absMask), _mm_set1_ps(ez)));
+    sphereNotInside |= _mm_movemask_ps(_mm_cmplt_ps(dist[h], r)) << (h * 4);
+    sphereOutside |= _mm_movemask_ps(_mm_cmplt_ps(dist[h], _mm_sub_ps(zero, r))) << (h * 4);
+  }
+
+  if (!sphereNotInside)
+    return inside;
+  if (sphereOutside)
+    return outside;
+
+  for (int h = 0; h < 2; h++)
+  {
+    boxOutside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist[h], support[h]), zero)) << (h * 4);
+    boxCrossing |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist[h], support[h]), zero)) << (h * 4);
+  }
+#endif
+
+  if (boxOutside)
+    return outside;
+  return boxCrossing ? intersecting : inside;
+}
@@ -0,0 +1,388 @@
+#include "engine.hpp"
+#include "fixed.hpp"
+#include <immintrin.h>
+
+/*
+  Half-space textured triangle kernel.
+
+  Vertices are snapped to 12.4 sub-pixels and each edge becomes an integer
+  edge function E(x, y) = a * x + b * y + c, sampled at pixel centers (see
+  EdgeFunction in fixed.hpp). A pixel is inside when all three are >= 0, the
+  fill rule bias (-1 on edges that are neither top nor left) makes shared
+  edges draw exactly once.
+
+  The bounding box is walked in 8x8 tiles. A tile outside one edge at all
+  four corners is skipped, a tile inside all three at its corners is drawn
+  without per-pixel edge tests. Other tiles step the edge functions by
+  addition across blocks spanning two rows: 2x2 with SSE2, 4x2 with AVX2.
+  w, u * w and v * w are planes over the screen, so u/v are perspective
+  correct. Depth test, texture fetch, colour modulation and fog run on the
+  whole block under a lane mask.
+
+  The scanline kernel clips its spans with the same edge functions, so both
+  kernels cover the same pixels.
+*/
+
+namespace
+{
+  constexpr int TILE = 8;
+
+  // smallest and largest offset of an edge function from a tile's first pixel
+  struct TileExtent
+  {
+    int32_t min, max;
+
+    explicit TileExtent(const EdgeFunction &e)
+        : min(std::min(0, e.a * (TILE - 1)) + std::min(0, e.b * (TILE - 1))),
+          max(std::max(0, e.a * (TILE - 1)) + std::max(0, e.b * (TILE - 1)))
+    {
+    }
+  };
+
+  // attribute value at a pixel center, first pixel of the region plus gradients
+  struct AttributePlane
+  {
+    float at0, dx, dy;
+  };
+}
+
+#ifdef __AVX2__
+
+static constexpr int BLOCK_W = 4;
+static constexpr int LANES = 8;
+
+typedef __m256 vfloat;
+typedef __m256i vint;
+
+// lanes 0..3 are the upper row, 4..7 the lower row
+static inline vfloat laneX() { return _mm256_setr_ps(0, 1, 2, 3, 0, 1, 2, 3); }
+static inline vfloat laneY() { return _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1); }
+static inline vfloat vset(float a) { return _mm256_set1_ps(a); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+static inline vfloat vor(vfloat a, vfloat b) { return _mm256_or_ps(a, b); }
+static inline vfloat vge(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline vfloat vlt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline vfloat vgt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline vfloat vneq(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+static inline int vmask(vfloat m) { return _mm256_movemask_ps(m); }
+static inline vint vtrunc(vfloat a) { return _mm256_cvttps_epi32(a); }
+static inline vfloat vtofloat(vint a) { return _mm256_cvtepi32_ps(a); }
+static inline vint vchannel(vint texels, int shift) { return _mm256_and_si256(_mm256_srli_epi32(texels, shift), _mm256_set1_epi32(0xff)); }
+static inline vint viand(vint a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+static inline vint viadd(vint a, vint b) { return _mm256_add_epi32(a, b); }
+static inline vint visrl(vint a, int n) { return _mm256_srli_epi32(a, n); }
+static inline vint visll(vint a, int n) { return _mm256_slli_epi32(a, n); }
+static inline vint viset(int a) { return _mm256_set1_epi32(a); }
+static inline vint vior(vint a, vint b) { return _mm256_or_si256(a, b); }
+static inline vint viload(const int32_t *p) { return _mm256_load_si256(reinterpret_cast<const __m256i *>(p)); }
+// lanes holding a value >= 0
+static inline vfloat vinside(vint e) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(e, _mm256_set1_epi32(-1))); }
+
+static inline vfloat loadDepth(const float *row0, const float *row1, vfloat m)
+{
+  __m256i mi = _mm256_castps_si256(m);
+  __m128 d0 = _mm_maskload_ps(row0, _mm256_castsi256_si128(mi));
+  __m128 d1 = _mm_maskload_ps(row1, _mm256_extracti128_si256(mi, 1));
+  return _mm256_set_m128(d1, d0);
+}
+
+static inline vint fetchTexels(const int *texels, vint index, vfloat m)
+{
+  return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), texels, index, _mm256_castps_si256(m), 4);
+}
+
+#else
+
+static constexpr int BLOCK_W = 2;
+static constexpr int LANES = 4;
+
+typedef __m128 vfloat;
+typedef __m128i vint;
+
+// lanes 0,1 are the upper row, 2,3 the lower row
+static inline vfloat laneX() { return _mm_setr_ps(0, 1, 0, 1); }
+static inline vfloat laneY() { return _mm_setr_ps(0, 0, 1, 1); }
+static inline vfloat vset(float a) { return _mm_set1_ps(a); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+static inline vfloat vor(vfloat a, vfloat b) { return _mm_or_ps(a, b); }
+static inline vfloat vge(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+static inline vfloat vlt(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+static inline vfloat vgt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+static inline vfloat vneq(vfloat a, vfloat b) { return _mm_cmpneq_ps(a, b); }
+static inline int vmask(vfloat m) { return _mm_movemask_ps(m); }
+static inline vint vtrunc(vfloat a) { return _mm_cvttps_epi32(a); }
+static inline vfloat vtofloat(vint a) { return _mm_cvtepi32_ps(a); }
+static inline vint vchannel(vint texels, int shift) { return _mm_and_si128(_mm_srli_epi32(texels, shift), _mm_set1_epi32(0xff)); }
+static inline vint viand(vint a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+static inline vint viadd(vint a, vint b) { return _mm_add_epi32(a, b); }
+static inline vint visrl(vint a, int n) { return _mm_srli_epi32(a, n); }
+static inline vint visll(vint a, int n) { return _mm_slli_epi32(a, n); }
+static inline vint viset(int a) { return _mm_set1_epi32(a); }
+static inline vint vior(vint a, vint b) { return _mm_or_si128(a, b); }
+static inline vint viload(const int32_t *p) { return _mm_load_si128(reinterpret_cast<const __m128i *>(p)); }
+// lanes holding a value >= 0
+static inline vfloat vinside(vint e) { return _mm_castsi128_ps(_mm_cmpgt_epi32(e, _mm_set1_epi32(-1))); }
+
+static inline vfloat loadDepth(const float *row0, const float *row1, vfloat m)
+{
+  int bits = _mm_movemask_ps(m);
+  alignas(16) float d[4] = {0, 0, 0, 0};
+  if (bits & 1) d[0] = row0[0];
+  if (bits & 2) d[1] = row0[1];
+  if (bits & 4) d[2] = row1[0];
+  if (bits & 8) d[3] = row1[1];
+  return _mm_load_ps(d);
+}
+
+static inline vint fetchTexels(const int *texels, vint index, vfloat m)
+{
+  int bits = _mm_movemask_ps(m);
+  alignas(16) int idx[4];
+  alignas(16) int out[4] = {0, 0, 0, 0};
+  _mm_store_si128(reinterpret_cast<__m128i *>(idx), index);
+  for (int l = 0; l < 4; l++)
+    if (bits & (1 << l))
+      out[l] = texels[idx[l]];
+  return _mm_load_si128(reinterpret_cast<const __m128i *>(out));
+}
+
+#endif
+
+// Vector version of Texture::index()
+static inline vint texelIndex(const Texture &texture, vfloat u, vfloat v)
+{
+  const vfloat texW = vset(texture.width);
+  const vfloat texH = vset(texture.height);
+  const vfloat stride = vset(texture.stride);
+  vint tx, ty;
+
+  if (texture.pow2)
+  {
+    tx = viand(vtrunc(vmul(u, texW)), texture.maskX);
+    ty = viand(vtrunc(vmul(v, texH)), texture.maskY);
+  }
+  else
+  {
+    const vfloat zeroV = vset(0.0f);
+    tx = vtrunc(vmin(vmax(vmul(u, texW), zeroV), vset(texture.width - 1)));
+    ty = vtrunc(vmin(vmax(vmul(v, texH), zeroV), vset(texture.height - 1)));
+  }
+
+  // indices stay far below 2^24, exact in float
+  if (texture.layout == Texture::linear)
+    return vtrunc(vadd(vmul(vtofloat(ty), stride), vtofloat(tx)));
+
+  const int mask = Texture::BLOCK_SIZE - 1;
+  vint block = vtrunc(vadd(vmul(vtofloat(visrl(ty, Texture::BLOCK_SHIFT)), stride),
+                           vtofloat(visrl(tx, Texture::BLOCK_SHIFT))));
+  return viadd(visll(block, 2 * Texture::BLOCK_SHIFT),
+               viadd(visll(viand(ty, mask), Texture::BLOCK_SHIFT), viand(tx, mask)));
+}
+
+bool Engine::HalfSpaceFillTextured(const Triangle &tri,
+                                   const Texture &texture, const Color &base_color, const ScreenRect &clip)
+{
+  const int *texels = reinterpret_cast<const int *>(texture.texels);
+
+  int32_t sx[3], sy[3];
+  for (int i = 0; i < 3; i++)
+  {
+    sx[i] = toSubpixel(tri.p[i].x);
+    sy[i] = toSubpixel(tri.p[i].y);
+  }
+
+  // wind the vertices so the inside is where the edge functions are positive
+  EdgeFunction edges[3];
+  int order[3];
+  if (!triangleEdges(sx, sy, edges, order))
+    return true;
+  const int i0 = order[0], i1 = order[1], i2 = order[2];
+  const TileExtent extents[3] = {TileExtent(edges[0]), TileExtent(edges[1]), TileExtent(edges[2])};
+
+  // pixels whose centers lie in the bounding box, inside the clip rect
+  int x0 = std::max(clip.x0, subpixelCeilCenter(std::min({sx[0], sx[1], sx[2]})));
+  int y0 = std::max(clip.y0, subpixelCeilCenter(std::min({sy[0], sy[1], sy[2]})));
+  int x1 = std::min(clip.x1, ((std::max({sx[0], sx[1], sx[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1);
+  int y1 = std::min(clip.y1, ((std::max({sy[0], sy[1], sy[2]}) - SUBPIXEL_ONE / 2) >> SUBPIXEL_SHIFT) + 1);
+  if (x0 >= x1 || y0 >= y1)
+    return true;
+
+  // edge functions are linear, so if they fit 32 bits at the corners of the
+  // tiles covering the box they fit everywhere in between
+  const int tileX0 = x0 & ~(TILE - 1), tileY0 = y0 & ~(TILE - 1);
+  const int tileX1 = (x1 - 1) | (TILE - 1), tileY1 = (y1 - 1) | (TILE - 1);
+  const int64_t limit = int64_t(1) << 30;
+  for (const EdgeFunction &e : edges)
+  {
+    for (int64_t v : {e.at(tileX0, tileY0), e.at(tileX1, tileY0), e.at(tileX0, tileY1), e.at(tileX1, tileY1)})
+      if (v < -limit || v > limit)
+        return false;
+  }
+
+  // w, u * w and v * w over the snapped triangle
+  float fx[3], fy[3];
+  for (int i = 0; i < 3; i++)
+  {
+    fx[i] = static_cast<float>(sx[order[i]]) * (1.0f / SUBPIXEL_ONE);
+    fy[i] = static_cast<float>(sy[order[i]]) * (1.0f / SUBPIXEL_ONE);
+  }
+  float dx1 = fx[1] - fx[0], dy1 = fy[1] - fy[0];
+  float dx2 = fx[2] - fx[0], dy2 = fy[2] - fy[0];
+  float invDenom = 1.0f / (dx1 * dy2 - dx2 * dy1);
+
+  auto plane = [&](float a0, float a1, float a2)
+  {
+    AttributePlane p;
+    float da1 = a1 - a0, da2 = a2 - a0;
+    p.dx = (da1 * dy2 - da2 * dy1) * invDenom;
+    p.dy = (da2 * dx1 - da1 * dx2) * invDenom;
+    p.at0 = a0 + p.dx * (x0 + 0.5f - fx[0]) + p.dy * (y0 + 0.5f - fy[0]);
+    return p;
+  };
+  const UV &t0 = tri.t[i0], &t1 = tri.t[i1], &t2 = tri.t[i2];
+  const AttributePlane pw = plane(t0.w, t1.w, t2.w);
+  const AttributePlane pu = plane(t0.u * t0.w, t1.u * t1.w, t2.u * t2.w);
+  const AttributePlane pv = plane(t0.v * t0.w, t1.v * t1.w, t2.v * t2.w);
+
+  const vfloat one = vset(1.0f);
+  const vfloat zeroV = vset(0.0f);
+  const vfloat allLanes = vneq(zeroV, one);
+  const vfloat modR = vset(base_color.r / 255.0f);
+  const vfloat modG = vset(base_color.g / 255.0f);
+  const vfloat modB = vset(base_color.b / 255.0f);
+  const vfloat fogScale = vset(fogW / 0.5f);
+  const vfloat fogR = vset(fogColor.r);
+  const vfloat fogG = vset(fogColor.g);
+  const vfloat fogB = vset(fogColor.b);
+  const vfloat sortAll = useSort ? allLanes : zeroV;
+  const vfloat lanesX = laneX();
+  const vfloat lanesY = laneY();
+  const vfloat clipX0 = vset(x0), clipX1 = vset(x1);
+  const vfloat clipY0 = vset(y0), clipY1 = vset(y1);
+
+  // per lane offsets from a block's first pixel, and steps to the next block
+  vint laneE[3], stepE[3];
+  for (int k = 0; k < 3; k++)
+  {
+    alignas(32) int32_t off[LANES];
+    for (int l = 0; l < LANES; l++)
+      off[l] = edges[k].a * (l % BLOCK_W) + edges[k].b * (l / BLOCK_W);
+    laneE[k] = viload(off);
+    stepE[k] = viset(edges[k].a * BLOCK_W);
+  }
+  const vfloat laneW = vadd(vmul(lanesX, vset(pw.dx)), vmul(lanesY, vset(pw.dy)));
+  const vfloat laneU = vadd(vmul(lanesX, vset(pu.dx)), vmul(lanesY, vset(pu.dy)));
+  const vfloat laneV = vadd(vmul(lanesX, vset(pv.dx)), vmul(lanesY, vset(pv.dy)));
+
+  // tiles and blocks sit on a fixed screen grid, so screen tiles see the same blocks
+  for (int ty = tileY0; ty < y1; ty += TILE)
+  {
+    for (int tx = tileX0; tx < x1; tx += TILE)
+    {
+      int32_t tileE[3];
+      bool reject = false, accept = true;
+      for (int k = 0; k < 3; k++)
+      {
+        tileE[k] = static_cast<int32_t>(edges[k].at(tx, ty));
+        reject |= tileE[k] + extents[k].max < 0;
+        accept &= tileE[k] + extents[k].min >= 0;
+      }
+      if (reject)
+        continue;
+
+      bool inClip = tx >= x0 && ty >= y0 && tx + TILE <= x1 && ty + TILE <= y1;
+      int bx0 = std::max(tx, x0) & ~(BLOCK_W - 1);
+      int bx1 = std::min(tx + TILE, x1);
+      int by0 = std::max(ty, y0) & ~1;
+      int by1 = std::min(ty + TILE, y1);
+
+      for (int y = by0; y < by1; y += 2)
+      {
+        vint e0 = viadd(viset(tileE[0] + edges[0].a * (bx0 - tx) + edges[0].b * (y - ty)), laneE[0]);
+        vint e1 = viadd(viset(tileE[1] + edges[1].a * (bx0 - tx) + edges[1].b * (y - ty)), laneE[1]);
+        vint e2 = viadd(viset(tileE[2] + edges[2].a * (bx0 - tx) + edges[2].b * (y - ty)), laneE[2]);
+        float rowW = pw.at0 + pw.dy * (y - y0);
+        float rowU = pu.at0 + pu.dy * (y - y0);
+        float rowV = pv.at0 + pv.dy * (y - y0);
+        vfloat py = vadd(vset(y), lanesY);
+        vfloat rowIn = vand(vge(py, clipY0), vlt(py, clipY1));
+
+        float *depth0 = &pDepthBuffer[y * width];
+        float *depth1 = &pDepthBuffer[(y + 1) * width];
+
+        for (int x = bx0; x < bx1; x += BLOCK_W,
+                 e0 = viadd(e0, stepE[0]), e1 = viadd(e1, stepE[1]), e2 = viadd(e2, stepE[2]))
+        {
+          vfloat covered = accept ? allLanes : vinside(vior(vior(e0, e1), e2));
+          if (!inClip)
+          {
+            vfloat px = vadd(vset(x), lanesX);
+            covered = vand(covered, vand(rowIn, vand(vge(px, clipX0), vlt(px, clipX1))));
+          }
+          if (!vmask(covered))
+            continue;
+
+          float dx = static_cast<float>(x - x0);
+          vfloat w = vadd(vset(rowW + pw.dx * dx), laneW);
+          covered = vand(covered, vneq(w, zeroV));
+
+          vfloat depth = loadDepth(depth0 + x, depth1 + x, covered);
+          covered = vand(covered, vor(vgt(w, depth), sortAll));
+
+          int bits = vmask(covered);
+          if (!bits)
+            continue;
+
+          // perspective-correct u/v, v flipped for texture coordinate system
+          vfloat u = vdiv(vadd(vset(rowU + pu.dx * dx), laneU), w);
+          vfloat vv = vsub(one, vdiv(vadd(vset(rowV + pv.dx * dx), laneV), w));
+
+          vint index = texelIndex(texture, u, vv);
+          vint texel = fetchTexels(texels, index, covered);
+
+          vfloat fog = vmin(vmax(vmul(w, fogScale), zeroV), one);
+          vfloat ifog = vsub(one, fog);
+
+          vfloat r = vtofloat(vtrunc(vmul(vtofloat(vchannel(texel, 0)), modR)));
+          vfloat g = vtofloat(vtrunc(vmul(vtofloat(vchannel(texel, 8)), modG)));
+          vfloat bl = vtofloat(vtrunc(vmul(vtofloat(vchannel(texel, 16)), modB)));
+
+          // channels stay within 0..255, so adding the shifted ones packs them
+          vint outR = vtrunc(vadd(vmul(r, fog), vmul(fogR, ifog)));
+          vint outG = vtrunc(vadd(vmul(g, fog), vmul(fogG, ifog)));
+          vint outB = vtrunc(vadd(vmul(bl, fog), vmul(fogB, ifog)));
+          alignas(32) uint32_t outRGB[LANES];
+          alignas(32) float outW[LANES];
+          *reinterpret_cast<vint *>(outRGB) = viadd(viadd(outR, visll(outG, 8)), visll(outB, 16));
+          *reinterpret_cast<vfloat *>(outW) = w;
+
+          for (int l = 0; l < LANES; l++)
+          {
+            if (!(bits & (1 << l)))
+              continue;
+
+            int py = y + l / BLOCK_W;
+            int pxl = x + l % BLOCK_W;
+            reinterpret_cast<uint32_t *>(videoBuffer)[py * width + pxl] = outRGB[l] | 0xFF000000u;
+
+            if (!useSort)
+              pDepthBuffer[py * width + pxl] = outW[l];
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
@@ -1,4 +1,5 @@
 #include <engine.hpp>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -52,55 +53,96 @@ void handleInputs(Engine *engine, Camera *camera, float cameraSpeed,
   }
 }
 
-bool loadModel(Engine *engine, const std::string &filename) {
-  try {
-    std::ifstream file(filename);
-    if (!file.good()) {
-      return false;
-    }
-    file.close();
+// Starts loading the model in the background, the main loop keeps running meanwhile.
+bool loadModel(Engine *engine, const std::string &filename, AssetRequest &request) {
+  std::ifstream file(filename);
+  if (!file.good() && !engine->pack.findMesh(filename)) {
+    return false;
+  }
+  file.close();
 
-    Vec3 position = {0, 0, 0};
-    if (!engine->components.createFromFile(filename, -1, position, true)) {
-      return false;
-    }
+  Vec3 position = {0, 0, 0};
+  request = engine->LoadComponentAsync(filename, -1, position, true);
+  return true;
+}
 
-    if (engine->components.components.empty()) {
-      return false;
-    }
+// Renders a fixed number of frames without a window and reports the average frame time.
+int runHeadless(Engine *engine, Camera *camera, int frames) {
+  auto start = std::chrono::steady_clock::now();
 
-    return true;
-  } catch (const std::exception &e) {
-    return false;
-  } catch (...) {
-    return false;
+  for (int i = 0; i < frames; i++) {
+    engine->calculateTriangles(camera->pos, camera->vTarget, camera->vUp);
+    engine->render(0);
   }
+
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+  printf("headless: %d frames, %0.3f ms/frame, %zu triangles\n", frames,
+         ms / (frames > 0 ? frames : 1), engine->vecTrianglesToRaster.size());
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
+  // usage: ps1_engine model.obj [--pack assets.pack] [--headless frames] [--pipelined]
+  int headlessFrames = 0;
+  bool pipelined = false;
+  std::string packFile;
+  if (argc < 2) {
     return 1;
   }
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--headless" && i + 1 < argc) {
+      headlessFrames = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--pack" && i + 1 < argc) {
+      packFile = argv[++i];
+    } else if (arg == "--pipelined") {
+      pipelined = true;
+    } else {
+      return 1;
+    }
+  }
 
-  Engine *engine = new Engine(60, 4, "PS1 Model Viewer");
+  Engine *engine = new Engine(60, 4, "PS1 Model Viewer", headlessFrames > 0);
   engine->setSort(true);
   engine->setDither(true);
+  engine->setPipelined(pipelined);
   Camera *camera = new Camera();
   camera->pos = {0, 0, -10};
   camera->vTarget = {0, 0, 0};
   camera->vUp = {0, 1, 0};
 
-  if (!loadModel(engine, argv[1])) {
+  if (!packFile.empty()) {
+    engine->LoadPack(packFile);
+  }
+
+  AssetRequest model;
+  if (!loadModel(engine, argv[1], model)) {
     delete camera;
     delete engine;
     return 1;
   }
 
+  if (headlessFrames > 0) {
+    engine->waitForLoads();
+    if (!model.ready.get()) {
+      delete camera;
+      delete engine;
+      return 1;
+    }
+
+    int result = runHeadless(engine, camera, headlessFrames);
+    delete camera;
+    delete engine;
+    return result;
+  }
+
   const float cameraSpeed = 5;
   const float cameraTurning = 1.0;
 
+  // render() clears after presenting each frame
+  int result = 0;
   while (engine->isOpen()) {
-    engine->clear();
     engine->checkEvents();
 
     handleInputs(engine, camera, cameraSpeed, cameraTurning);
@@ -111,9 +153,14 @@ int main(int argc, char *argv[]) {
     engine->calculateTriangles(camera->pos, camera->vTarget, camera->vUp);
     engine->render(0);
     needUpdate = false;
+
+    if (model.isReady() && !model.ready.get()) {
+      result = 1;
+      break;
+    }
   }
 
   delete camera;
   delete engine;
-  return 0;
+  return result;
 }
\ No newline at end of file
@@ -1,94 +1,37 @@
 #include <mesh.hpp>
+#include "assetPack.hpp"
+#include "objParser.hpp"
+#include "meshSimplify.hpp"
+#include "resourceCache.hpp"
 #include <iostream>
 #include <vector> // Required for std::vector
-#include <string> // Required for std::string, std::stoi
+#include <string> // Required for std::string
 #include <algorithm> // Required for std::min, std::max
+#include <unordered_map>
+#include <cstring>
 
-// Temporary structure to hold face data (vertex and UV indices)
-struct FaceData {
-    int v_indices[3];
-    int uv_indices[3];
-    bool has_uvs;
-};
-
-bool Mesh::LoadObjFromFile(std::string filename, bool centerModel)
+bool MeshData::LoadObjFromFile(std::string filename, bool centerModel)
 {
-    std::ifstream f(filename);
-    if (!f.is_open())
+    ObjData obj;
+    if (!ParseObj(filename, obj))
         return false;
 
-    std::vector<Vec3> local_verts; // Cache for raw vertex positions
-    std::vector<UV> local_uvs;     // Cache for raw UV coordinates
-    std::vector<FaceData> face_data_list; // Cache for face definitions
+    std::vector<Vec3> &local_verts = obj.positions; // Raw vertex positions
+    std::vector<UV> &local_uvs = obj.uvs;           // Raw UV coordinates
 
     // Initialize AABB with large/small values
     aabb.min = {10000.0f, 10000.0f, 10000.0f};
     aabb.max = {-10000.0f, -10000.0f, -10000.0f};
 
-    std::string line_str;
-    while (std::getline(f, line_str))
-    {
-        std::stringstream s;
-        s << line_str;
-        char junk;
-
-        if (line_str[0] == 'v' && line_str[1] == ' ')
-        {
-            Vec3 v;
-            s >> junk >> v.x >> v.y >> v.z;
-            local_verts.push_back(v);
-
-            // Update AABB based on raw vertices
-            aabb.min.x = std::min(aabb.min.x, v.x);
-            aabb.min.y = std::min(aabb.min.y, v.y);
-            aabb.min.z = std::min(aabb.min.z, v.z);
-            aabb.max.x = std::max(aabb.max.x, v.x);
-            aabb.max.y = std::max(aabb.max.y, v.y);
-            aabb.max.z = std::max(aabb.max.z, v.z);
-        }
-        else if (line_str[0] == 'v' && line_str[1] == 't')
-        {
-            UV uv;
-            std::string junkWord; // vt can be followed by more than one char
-            s >> junkWord >> uv.u >> uv.v;
-            local_uvs.push_back(uv);
-        }
-        else if (line_str[0] == 'f')
-        {
-            FaceData current_face;
-            current_face.has_uvs = false;
-            std::string face_tokens[3];
-            s >> junk >> face_tokens[0] >> face_tokens[1] >> face_tokens[2];
-
-            for (int i = 0; i < 3; ++i) {
-                std::string token = face_tokens[i];
-                std::size_t first_slash = token.find('/');
-                
-                current_face.v_indices[i] = std::stoi(token.substr(0, first_slash));
-
-                if (first_slash != std::string::npos) {
-                    // Check for UV coordinates
-                    std::size_t second_slash = token.find('/', first_slash + 1);
-                    if (second_slash != first_slash +1 && first_slash + 1 < token.length() && (second_slash == std::string::npos || second_slash > first_slash + 1) ) {
-                         // Check if the character after the first slash is a digit
-                        if (isdigit(token[first_slash+1])) {
-                            current_face.uv_indices[i] = std::stoi(token.substr(first_slash + 1, second_slash - (first_slash + 1)));
-                            current_face.has_uvs = true;
-                        } else { // If no digit after first slash, no UV for this vertex
-                             current_face.uv_indices[i] = 0; // Default or indicate no UV
-                        }
-                    } else {
-                        current_face.uv_indices[i] = 0; // Default if no UV index part
-                    }
-                    // Normals would be after the second slash, ignored for now
-                } else {
-                     current_face.uv_indices[i] = 0; // No slashes, so no UVs
-                }
-            }
-            face_data_list.push_back(current_face);
-        }
+    // Update AABB based on raw vertices
+    for (const Vec3 &v : local_verts) {
+        aabb.min.x = std::min(aabb.min.x, v.x);
+        aabb.min.y = std::min(aabb.min.y, v.y);
+        aabb.min.z = std::min(aabb.min.z, v.z);
+        aabb.max.x = std::max(aabb.max.x, v.x);
+        aabb.max.y = std::max(aabb.max.y, v.y);
+        aabb.max.z = std::max(aabb.max.z, v.z);
     }
-    f.close(); // Close the file stream once parsing is done.
 
     if (local_verts.empty()) {
       // std::cerr << "No vertices found in OBJ file: " << filename << std::endl;
@@ -115,44 +58,54 @@ bool Mesh::LoadObjFromFile(std::string filename, bool centerModel)
         // std::cout << "Model centering skipped for: " << filename << std::endl;
     }
 
-    // Now create triangles using the (potentially adjusted) vertices and cached face data
+    // Now build the indexed mesh, one vertex per unique position/uv pair
     UV defaultUVs[3] = {{0, 0, 1}, {1, 0, 1}, {0, 1, 1}}; // Added w=1
+    std::unordered_map<uint64_t, uint32_t> vertexLookup;
+    vertexLookup.reserve(local_verts.size() * 2);
 
-    for (const auto& face_def : face_data_list) {
-        Vec3 tri_verts[3];
-        UV tri_uvs[3];
+    packed = MeshView();
+    positions.clear();
+    uvs.clear();
+    indices.clear();
+    lods.clear();
+    indices.reserve(obj.corners.size());
 
+    for (size_t t = 0; t < obj.corners.size(); t += 3) {
         for (int i = 0; i < 3; ++i) {
-            if (face_def.v_indices[i] > 0 && face_def.v_indices[i] <= local_verts.size()) {
-                tri_verts[i] = local_verts[face_def.v_indices[i] - 1];
+            const ObjCorner &corner = obj.corners[t + i];
+            uint32_t v_key = corner.v + 1; // 0 marks an invalid index
+
+            uint32_t uv_key;
+            if (corner.vt >= 0) {
+                uv_key = corner.vt + 1;
             } else {
-                // Handle error or default vertex
-                // std::cerr << "Invalid vertex index: " << face_def.v_indices[i] << std::endl;
-                tri_verts[i] = {0,0,0,1}; // Default
+                uv_key = UINT32_MAX - i; // Cycle through default UVs
             }
 
-            if (face_def.has_uvs && face_def.uv_indices[i] > 0 && face_def.uv_indices[i] <= local_uvs.size()) {
-                tri_uvs[i] = local_uvs[face_def.uv_indices[i] - 1];
-            } else {
-                tri_uvs[i] = defaultUVs[i % 3]; // Cycle through default UVs
+            uint64_t key = (static_cast<uint64_t>(v_key) << 32) | uv_key;
+            auto it = vertexLookup.find(key);
+            if (it == vertexLookup.end()) {
+                it = vertexLookup.emplace(key, static_cast<uint32_t>(positions.size())).first;
+                // Handle error or default vertex
+                positions.push_back(v_key ? local_verts[v_key - 1] : Vec3{0, 0, 0, 1});
+                uvs.push_back(uv_key <= local_uvs.size() ? local_uvs[uv_key - 1] : defaultUVs[i % 3]);
             }
+            indices.push_back(it->second);
         }
-        tris.push_back({tri_verts[0], tri_verts[1], tri_verts[2], tri_uvs[0], tri_uvs[1], tri_uvs[2], {255, 255, 255}});
     }
 
-    // Recalculate AABB based on the *adjusted* (centered) triangle vertices
-    if (!tris.empty()) {
-        aabb.min = tris[0].p[0];
-        aabb.max = tris[0].p[0];
-        for (const auto& tri : tris) {
-            for (int i = 0; i < 3; i++) {
-                aabb.min.x = std::min(aabb.min.x, tri.p[i].x);
-                aabb.min.y = std::min(aabb.min.y, tri.p[i].y);
-                aabb.min.z = std::min(aabb.min.z, tri.p[i].z);
-                aabb.max.x = std::max(aabb.max.x, tri.p[i].x);
-                aabb.max.y = std::max(aabb.max.y, tri.p[i].y);
-                aabb.max.z = std::max(aabb.max.z, tri.p[i].z);
-            }
+    // Recalculate AABB based on the *adjusted* (centered) vertices
+    if (!positions.empty()) {
+        aabb.min = positions.at(0);
+        aabb.max = positions.at(0);
+        for (size_t i = 0; i < positions.size(); i++) {
+            Vec3 v = positions.at(i);
+            aabb.min.x = std::min(aabb.min.x, v.x);
+            aabb.min.y = std::min(aabb.min.y, v.y);
+            aabb.min.z = std::min(aabb.min.z, v.z);
+            aabb.max.x = std::max(aabb.max.x, v.x);
+            aabb.max.y = std::max(aabb.max.y, v.y);
+            aabb.max.z = std::max(aabb.max.z, v.z);
         }
     } else if (local_verts.empty()){
         // If there were no vertices at all, AABB remains as initially set (large/small values)
@@ -162,10 +115,104 @@ bool Mesh::LoadObjFromFile(std::string filename, bool centerModel)
     }
 
 
-    // std::cout << "Loaded " << tris.size() << " triangles" << (centerModel ? " (centered)" : " (original pivot)") << std::endl;
+    // std::cout << "Loaded " << triangleCount() << " triangles, " << positions.size() << " vertices" << (centerModel ? " (centered)" : " (original pivot)") << std::endl;
     // std::cout << (centerModel ? "Centered AABB: " : "Original AABB: ");
     // std::cout << "min(" << aabb.min.x << "," << aabb.min.y << "," << aabb.min.z << ") ";
     // std::cout << "max(" << aabb.max.x << "," << aabb.max.y << "," << aabb.max.z << ")" << std::endl;
 
     return true;
-}
\ No newline at end of file
+}
+
+static bool viewFromPack(const AssetPack &pack, const std::string &name, bool centerModel, MeshView &view, AABB &aabb)
+{
+    const PackMeshHeader *h = pack.findMesh(name);
+    if (!h || (h->centered != 0) != centerModel)
+        return false;
+    if (!pack.indicesValid(*h)) {
+        printf("Corrupt mesh in asset pack: %s\n", name.c_str());
+        return false;
+    }
+
+    view.x = pack.at<float>(h->xOffset);
+    view.y = pack.at<float>(h->yOffset);
+    view.z = pack.at<float>(h->zOffset);
+    view.uvs = pack.at<UV>(h->uvOffset);
+    view.indices = pack.at<uint32_t>(h->indexOffset);
+    view.vertexCount = h->vertexCount;
+    view.indexCount = h->indexCount;
+    aabb = h->aabb;
+    return true;
+}
+
+bool MeshData::LoadFromPack(const AssetPack &pack, const std::string &name, bool centerModel)
+{
+    MeshView view;
+    if (!viewFromPack(pack, name, centerModel, view, aabb))
+        return false;
+
+    positions.clear();
+    uvs.clear();
+    indices.clear();
+    lods.clear();
+    packed = view;
+
+    for (int level = 1; level < LOD_LEVELS; level++) {
+        MeshData lod;
+        if (!viewFromPack(pack, name + "#lod" + std::to_string(level), centerModel, lod.packed, lod.aabb))
+            break;
+        lods.push_back(std::move(lod));
+    }
+    return true;
+}
+
+void MeshData::generateLods()
+{
+    lods.clear();
+    lods.reserve(LOD_LEVELS - 1);
+
+    // each level is simplified from the previous one, which is much cheaper than from level 0
+    const MeshData *src = this;
+    for (int level = 1; level < LOD_LEVELS; level++) {
+        MeshData lod;
+        if (!SimplifyMesh(src->view(), triangleCount() >> level, lod))
+            break;
+        // border heavy meshes stop simplifying early, a level saving less than a quarter is not worth it
+        if (lod.triangleCount() * 4 > src->triangleCount() * 3)
+            break;
+        lod.aabb = aabb;
+        lods.push_back(std::move(lod));
+        src = &lods.back();
+    }
+}
+
+size_t MeshData::memoryUsed() const
+{
+    size_t bytes = positions.size() * 3 * sizeof(float) + uvs.size() * sizeof(UV) + indices.size() * sizeof(uint32_t);
+    for (const MeshData &lod : lods)
+        bytes += lod.memoryUsed();
+    return bytes;
+}
+
+uint64_t MeshData::contentHash() const
+{
+    MeshView v = view();
+    uint64_t h = HashBytes(v.x, v.vertexCount * sizeof(float));
+    h = HashBytes(v.y, v.vertexCount * sizeof(float), h);
+    h = HashBytes(v.z, v.vertexCount * sizeof(float), h);
+    h = HashBytes(v.uvs, v.vertexCount * sizeof(UV), h);
+    return HashBytes(v.indices, v.indexCount * sizeof(uint32_t), h);
+}
+
+bool MeshData::sameContent(const MeshData &other) const
+{
+    MeshView a = view(), b = other.view();
+    if (a.vertexCount != b.vertexCount || a.indexCount != b.indexCount)
+        return false;
+
+    size_t n = a.vertexCount;
+    return memcmp(a.x, b.x, n * sizeof(float)) == 0 &&
+           memcmp(a.y, b.y, n * sizeof(float)) == 0 &&
+           memcmp(a.z, b.z, n * sizeof(float)) == 0 &&
+           memcmp(a.uvs, b.uvs, n * sizeof(UV)) == 0 &&
+           memcmp(a.indices, b.indices, a.indexCount * sizeof(uint32_t)) == 0;
+}
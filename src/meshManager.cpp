@@ -1 +1,30 @@
-#include "meshManager.hpp"
\ No newline at end of file
+#include "meshManager.hpp"
+
+std::shared_ptr<const MeshData> LoadMeshData(const std::string &filename, bool centerModel,
+                                             const AssetPack *pack, MeshCache *cache)
+{
+  std::string key = filename + (centerModel ? "|centered" : "|pivot");
+
+  if (cache)
+  {
+    std::shared_ptr<const MeshData> cached = cache->find(key);
+    if (cached)
+      return cached;
+  }
+
+  auto data = std::make_shared<MeshData>();
+  bool fromPack = pack && data->LoadFromPack(*pack, filename, centerModel);
+  bool ok = fromPack || data->LoadObjFromFile(filename, centerModel);
+  if (!ok)
+    return nullptr;
+  // packs cooked with lods already mapped them
+  if (data->lods.empty())
+    data->generateLods();
+
+  if (!cache)
+    return data;
+  // pack entries are unique by name, only meshes parsed from files are matched by content
+  if (fromPack)
+    return cache->insert(key, data, data->memoryUsed());
+  return cache->insert(key, data->contentHash(), data, data->memoryUsed());
+}
@@ -0,0 +1,293 @@
+#include "meshSimplify.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+  // symmetric 4x4 error matrix, upper triangle: xx xy xz xw yy yz yw zz zw ww
+  struct Quadric
+  {
+    double q[10] = {0};
+
+    void addPlane(double a, double b, double c, double d, double weight)
+    {
+      q[0] += weight * a * a;
+      q[1] += weight * a * b;
+      q[2] += weight * a * c;
+      q[3] += weight * a * d;
+      q[4] += weight * b * b;
+      q[5] += weight * b * c;
+      q[6] += weight * b * d;
+      q[7] += weight * c * c;
+      q[8] += weight * c * d;
+      q[9] += weight * d * d;
+    }
+
+    void add(const Quadric &o)
+    {
+      for (int i = 0; i < 10; i++)
+        q[i] += o.q[i];
+    }
+
+    double error(const Vec3 &p) const
+    {
+      double x = p.x, y = p.y, z = p.z;
+      return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+             q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+             q[7] * z * z + 2 * q[8] * z + q[9];
+    }
+  };
+
+  struct Key3
+  {
+    uint32_t a, b, c;
+    bool operator==(const Key3 &o) const { return a == o.a && b == o.b && c == o.c; }
+  };
+
+  struct Key3Hash
+  {
+    size_t operator()(const Key3 &k) const
+    {
+      uint64_t h = k.a * 0x9E3779B97F4A7C15ull;
+      h ^= (h >> 29) + k.b * 0xBF58476D1CE4E5B9ull;
+      h ^= (h >> 31) + k.c * 0x94D049BB133111EBull;
+      return static_cast<size_t>(h ^ (h >> 32));
+    }
+  };
+
+  inline uint32_t floatBits(float f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+  }
+
+  // 'from' moves onto 'to', stamps tell whether either vertex changed since
+  struct Collapse
+  {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t fromStamp;
+    uint32_t toStamp;
+
+    bool operator>(const Collapse &o) const { return cost > o.cost; }
+  };
+
+  inline Vec3 sub(const Vec3 &a, const Vec3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+  inline Vec3 cross(const Vec3 &a, const Vec3 &b) { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+  inline float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+}
+
+bool SimplifyMesh(const MeshView &in, size_t targetTriangles, MeshData &out)
+{
+  size_t numTris = in.indexCount / 3;
+  if (numTris == 0)
+    return false;
+
+  // weld vertices that only differ by uv into one position
+  std::unordered_map<Key3, uint32_t, Key3Hash> positionLookup;
+  std::vector<uint32_t> groupOf(in.vertexCount);
+  std::vector<Vec3> pos;
+  for (size_t i = 0; i < in.vertexCount; i++)
+  {
+    Key3 key = {floatBits(in.x[i]), floatBits(in.y[i]), floatBits(in.z[i])};
+    auto it = positionLookup.emplace(key, static_cast<uint32_t>(pos.size())).first;
+    if (it->second == pos.size())
+      pos.push_back({in.x[i], in.y[i], in.z[i]});
+    groupOf[i] = it->second;
+  }
+  size_t numGroups = pos.size();
+
+  std::vector<uint32_t> corner(numTris * 3);
+  std::vector<UV> cornerUV(numTris * 3);
+  std::vector<uint8_t> alive(numTris, 1);
+  std::vector<std::vector<uint32_t>> groupTris(numGroups);
+  std::vector<Quadric> quadrics(numGroups);
+  size_t liveTris = numTris;
+
+  for (size_t t = 0; t < numTris; t++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t v = in.indices[t * 3 + i];
+      corner[t * 3 + i] = groupOf[v];
+      cornerUV[t * 3 + i] = in.uvs[v];
+    }
+
+    const uint32_t *c = &corner[t * 3];
+    if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+    {
+      alive[t] = 0;
+      liveTris--;
+      continue;
+    }
+    for (int i = 0; i < 3; i++)
+      groupTris[c[i]].push_back(static_cast<uint32_t>(t));
+
+    // plane quadric weighted by area, so big faces hold their shape
+    Vec3 n = cross(sub(pos[c[1]], pos[c[0]]), sub(pos[c[2]], pos[c[0]]));
+    double len = std::sqrt((double)dot(n, n));
+    if (len <= 0)
+      continue;
+    double a = n.x / len, b = n.y / len, cc = n.z / len;
+    double d = -(a * pos[c[0]].x + b * pos[c[0]].y + cc * pos[c[0]].z);
+    for (int i = 0; i < 3; i++)
+      quadrics[c[i]].addPlane(a, b, cc, d, len * 0.5);
+  }
+
+  // edges used by a single triangle are borders, their vertices stay put
+  std::unordered_map<uint64_t, int> edgeUse;
+  edgeUse.reserve(liveTris * 3);
+  for (size_t t = 0; t < numTris; t++)
+  {
+    if (!alive[t])
+      continue;
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t a = corner[t * 3 + i], b = corner[t * 3 + (i + 1) % 3];
+      uint64_t key = a < b ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+      edgeUse[key]++;
+    }
+  }
+
+  std::vector<uint8_t> locked(numGroups, 0);
+  std::vector<uint8_t> removed(numGroups, 0);
+  std::vector<uint32_t> stamp(numGroups, 0);
+  for (const auto &e : edgeUse)
+  {
+    if (e.second == 1)
+    {
+      locked[e.first >> 32] = 1;
+      locked[e.first & 0xFFFFFFFFu] = 1;
+    }
+  }
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+  auto pushEdge = [&](uint32_t a, uint32_t b)
+  {
+    if (locked[a] && locked[b])
+      return;
+    Quadric q = quadrics[a];
+    q.add(quadrics[b]);
+    const double never = std::numeric_limits<double>::infinity();
+    double aOntoB = locked[a] ? never : q.error(pos[b]);
+    double bOntoA = locked[b] ? never : q.error(pos[a]);
+    if (aOntoB <= bOntoA)
+      heap.push({aOntoB, a, b, stamp[a], stamp[b]});
+    else
+      heap.push({bOntoA, b, a, stamp[b], stamp[a]});
+  };
+
+  for (const auto &e : edgeUse)
+    pushEdge(static_cast<uint32_t>(e.first >> 32), static_cast<uint32_t>(e.first & 0xFFFFFFFFu));
+  edgeUse.clear();
+
+  std::vector<uint32_t> neighbours;
+  while (liveTris > targetTriangles && !heap.empty())
+  {
+    Collapse c = heap.top();
+    heap.pop();
+    if (removed[c.from] || removed[c.to] || stamp[c.from] != c.fromStamp || stamp[c.to] != c.toStamp)
+      continue;
+
+    // triangles that stay must not turn over or collapse to a line
+    bool flips = false;
+    for (uint32_t t : groupTris[c.from])
+    {
+      const uint32_t *tc = &corner[t * 3];
+      if (!alive[t] || tc[0] == c.to || tc[1] == c.to || tc[2] == c.to)
+        continue;
+
+      Vec3 p[3] = {pos[tc[0]], pos[tc[1]], pos[tc[2]]};
+      Vec3 before = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+      for (int i = 0; i < 3; i++)
+        if (tc[i] == c.from)
+          p[i] = pos[c.to];
+      Vec3 after = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+      if (dot(before, after) <= 0.0f)
+      {
+        flips = true;
+        break;
+      }
+    }
+    if (flips)
+      continue;
+
+    for (uint32_t t : groupTris[c.from])
+    {
+      if (!alive[t])
+        continue;
+      uint32_t *tc = &corner[t * 3];
+      if (tc[0] == c.to || tc[1] == c.to || tc[2] == c.to)
+      {
+        alive[t] = 0;
+        liveTris--;
+        continue;
+      }
+      for (int i = 0; i < 3; i++)
+        if (tc[i] == c.from)
+          tc[i] = c.to;
+      groupTris[c.to].push_back(t);
+    }
+    removed[c.from] = 1;
+    groupTris[c.from].clear();
+    quadrics[c.to].add(quadrics[c.from]);
+    stamp[c.to]++;
+
+    // drop dead triangles and requeue every edge of the merged vertex
+    std::vector<uint32_t> &tris = groupTris[c.to];
+    size_t n = 0;
+    neighbours.clear();
+    for (uint32_t t : tris)
+    {
+      if (!alive[t])
+        continue;
+      tris[n++] = t;
+      for (int i = 0; i < 3; i++)
+        if (corner[t * 3 + i] != c.to)
+          neighbours.push_back(corner[t * 3 + i]);
+    }
+    tris.resize(n);
+
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    for (uint32_t nb : neighbours)
+      pushEdge(c.to, nb);
+  }
+
+  // rebuild indexed vertices, one per remaining position/uv pair, in first use order
+  std::unordered_map<Key3, uint32_t, Key3Hash> vertexLookup;
+  out.packed = MeshView();
+  out.positions.clear();
+  out.uvs.clear();
+  out.indices.clear();
+  out.lods.clear();
+  out.indices.reserve(liveTris * 3);
+
+  for (size_t t = 0; t < numTris; t++)
+  {
+    if (!alive[t])
+      continue;
+    for (int i = 0; i < 3; i++)
+    {
+      uint32_t g = corner[t * 3 + i];
+      const UV &uv = cornerUV[t * 3 + i];
+      Key3 key = {g, floatBits(uv.u), floatBits(uv.v)};
+      auto it = vertexLookup.emplace(key, static_cast<uint32_t>(out.positions.size())).first;
+      if (it->second == out.positions.size())
+      {
+        out.positions.push_back(pos[g]);
+        out.uvs.push_back(uv);
+      }
+      out.indices.push_back(it->second);
+    }
+  }
+
+  return !out.indices.empty();
+}
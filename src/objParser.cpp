@@ -0,0 +1,254 @@
+#include "objParser.hpp"
+#include "threadPool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+  // small files are parsed on the calling thread only
+  constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+  // Relative indices can point before the chunk, so they are kept as
+  // offsets from the chunk's first element and fixed up after stitching
+  constexpr uint8_t REL_V = 1;
+  constexpr uint8_t REL_VT = 2;
+
+  struct ChunkCorner
+  {
+    int32_t v;
+    int32_t vt;
+    uint8_t flags;
+  };
+
+  struct Chunk
+  {
+    const char *begin;
+    const char *end;
+    std::vector<Vec3> positions;
+    std::vector<UV> uvs;
+    std::vector<ChunkCorner> corners;
+  };
+
+  inline const char *skipSpaces(const char *p, const char *end)
+  {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    return p;
+  }
+
+  inline const char *parseFloat(const char *p, const char *end, float &value)
+  {
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+')
+      p++;
+    auto r = std::from_chars(p, end, value);
+    return r.ec == std::errc() ? r.ptr : nullptr;
+  }
+
+  inline const char *parseInt(const char *p, const char *end, int32_t &value)
+  {
+    if (p < end && *p == '+')
+      p++;
+    auto r = std::from_chars(p, end, value);
+    return r.ec == std::errc() ? r.ptr : nullptr;
+  }
+
+  // OBJ index (1-based, or negative relative to 'count') to a chunk local
+  // 0-based index, invalid indices become -1
+  inline void resolveIndex(int32_t raw, size_t count, uint8_t relFlag, int32_t &index, uint8_t &flags)
+  {
+    if (raw > 0)
+    {
+      index = raw - 1;
+    }
+    else if (raw < 0)
+    {
+      index = static_cast<int32_t>(count) + raw;
+      flags |= relFlag;
+    }
+    else
+    {
+      index = -1;
+    }
+  }
+
+  void parseChunk(Chunk &c)
+  {
+    std::vector<ChunkCorner> face;
+    const char *p = c.begin;
+
+    while (p < c.end)
+    {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', c.end - p));
+      if (!eol)
+        eol = c.end;
+
+      const char *q = skipSpaces(p, eol);
+
+      if (eol - q >= 2 && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+      {
+        Vec3 v;
+        const char *r = parseFloat(q + 2, eol, v.x);
+        if (r)
+          r = parseFloat(r, eol, v.y);
+        if (r)
+          r = parseFloat(r, eol, v.z);
+        c.positions.push_back(v);
+      }
+      else if (eol - q >= 3 && q[0] == 'v' && q[1] == 't' && (q[2] == ' ' || q[2] == '\t'))
+      {
+        UV uv;
+        const char *r = parseFloat(q + 3, eol, uv.u);
+        if (r)
+          parseFloat(r, eol, uv.v);
+        c.uvs.push_back(uv);
+      }
+      else if (eol - q >= 2 && q[0] == 'f' && (q[1] == ' ' || q[1] == '\t'))
+      {
+        face.clear();
+        const char *r = q + 2;
+
+        // corners are v, v/vt, v//vn or v/vt/vn
+        while (true)
+        {
+          r = skipSpaces(r, eol);
+          if (r >= eol || *r == '\r' || *r == '#')
+            break;
+
+          int32_t v = 0, vt = 0;
+          const char *t = parseInt(r, eol, v);
+          if (!t)
+            break;
+          if (t < eol && *t == '/')
+          {
+            t++;
+            if (t < eol && *t != '/')
+            {
+              const char *u = parseInt(t, eol, vt);
+              t = u ? u : t;
+            }
+            if (t < eol && *t == '/')
+            {
+              t++;
+              int32_t vn;
+              const char *u = parseInt(t, eol, vn);
+              t = u ? u : t;
+            }
+          }
+
+          ChunkCorner corner = {0, 0, 0};
+          resolveIndex(v, c.positions.size(), REL_V, corner.v, corner.flags);
+          resolveIndex(vt, c.uvs.size(), REL_VT, corner.vt, corner.flags);
+          face.push_back(corner);
+
+          // skip whatever is left of a malformed token
+          while (t < eol && *t != ' ' && *t != '\t')
+            t++;
+          r = t;
+        }
+
+        for (size_t i = 1; i + 1 < face.size(); i++)
+        {
+          c.corners.push_back(face[0]);
+          c.corners.push_back(face[i]);
+          c.corners.push_back(face[i + 1]);
+        }
+      }
+
+      p = eol + 1;
+    }
+  }
+}
+
+bool ParseObj(const std::string &filename, ObjData &out)
+{
+  FILE *f = fopen(filename.c_str(), "rb");
+  if (!f)
+    return false;
+
+  std::vector<char> text;
+  fseek(f, 0, SEEK_END);
+  long length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (length > 0)
+  {
+    text.resize(length);
+    if (fread(text.data(), 1, length, f) != (size_t)length)
+    {
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+
+  const char *begin = text.data();
+  const char *end = begin + text.size();
+
+  // split at line ends, roughly one chunk per thread
+  size_t threads = std::thread::hardware_concurrency();
+  size_t numChunks = std::max<size_t>(1, std::min(threads, text.size() / MIN_CHUNK_BYTES));
+  std::vector<Chunk> chunks(numChunks);
+
+  const char *p = begin;
+  for (size_t i = 0; i < numChunks; i++)
+  {
+    const char *e = i + 1 == numChunks ? end : begin + text.size() * (i + 1) / numChunks;
+    if (e < p)
+      e = p;
+    while (e < end && e[-1] != '\n')
+      e++;
+    chunks[i].begin = p;
+    chunks[i].end = e;
+    p = e;
+  }
+
+  if (numChunks > 1)
+  {
+    ThreadPool pool(static_cast<unsigned>(numChunks - 1));
+    pool.parallelFor(numChunks, [&](size_t i)
+                     { parseChunk(chunks[i]); });
+  }
+  else
+  {
+    parseChunk(chunks[0]);
+  }
+
+  // stitch in file order, relative and out of range indices are fixed up here
+  size_t numPositions = 0, numUVs = 0, numCorners = 0;
+  for (const Chunk &c : chunks)
+  {
+    numPositions += c.positions.size();
+    numUVs += c.uvs.size();
+    numCorners += c.corners.size();
+  }
+
+  out.positions.clear();
+  out.uvs.clear();
+  out.corners.clear();
+  out.positions.reserve(numPositions);
+  out.uvs.reserve(numUVs);
+  out.corners.reserve(numCorners);
+
+  for (const Chunk &c : chunks)
+  {
+    int64_t vBase = out.positions.size();
+    int64_t vtBase = out.uvs.size();
+    out.positions.insert(out.positions.end(), c.positions.begin(), c.positions.end());
+    out.uvs.insert(out.uvs.end(), c.uvs.begin(), c.uvs.end());
+
+    for (const ChunkCorner &cc : c.corners)
+    {
+      int64_t v = cc.v + ((cc.flags & REL_V) ? vBase : 0);
+      int64_t vt = cc.vt + ((cc.flags & REL_VT) ? vtBase : 0);
+      ObjCorner corner;
+      corner.v = (cc.v >= 0 || (cc.flags & REL_V)) && v >= 0 && v < (int64_t)numPositions ? (int32_t)v : -1;
+      corner.vt = (cc.vt >= 0 || (cc.flags & REL_VT)) && vt >= 0 && vt < (int64_t)numUVs ? (int32_t)vt : -1;
+      out.corners.push_back(corner);
+    }
+  }
+
+  return true;
+}
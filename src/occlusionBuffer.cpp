@@ -0,0 +1,174 @@
+#include "occlusionBuffer.hpp"
+#include <algorithm>
+#include <cmath>
+
+void OcclusionBuffer::resize(int screenWidth, int screenHeight, int scale, int coverWidth, int coverHeight)
+{
+  this->scale = std::max(1, std::min(scale, MAX_SCALE));
+  this->screenWidth = screenWidth;
+  this->screenHeight = screenHeight;
+  this->coverWidth = std::min(coverWidth, screenWidth);
+  this->coverHeight = std::min(coverHeight, screenHeight);
+
+  int width = (screenWidth + this->scale - 1) / this->scale;
+  int height = (screenHeight + this->scale - 1) / this->scale;
+  coverage.assign((size_t)width * height, 0);
+  coveredW.assign((size_t)width * height, 0.0f);
+  levels.clear();
+  while (true)
+  {
+    Level l;
+    l.width = width;
+    l.height = height;
+    l.minW.assign((size_t)width * height, 0.0f);
+    // level 0 holds exact depths, min and max are the same
+    if (!levels.empty())
+      l.maxW.assign((size_t)width * height, 0.0f);
+    levels.push_back(std::move(l));
+
+    if (width == 1 && height == 1)
+      break;
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+}
+
+void OcclusionBuffer::clear()
+{
+  std::fill(coverage.begin(), coverage.end(), 0);
+}
+
+void OcclusionBuffer::drawTriangle(const float *x, const float *y, const float *w)
+{
+  const Level &l = levels[0];
+
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0.0f)
+    return;
+  // edge functions are made positive inside whatever the winding
+  float sign = area > 0.0f ? 1.0f : -1.0f;
+  float invArea = 1.0f / (area * sign);
+
+  int minX = std::max(0, static_cast<int>(std::floor(std::min({x[0], x[1], x[2]}))));
+  int maxX = std::min(coverWidth - 1, static_cast<int>(std::ceil(std::max({x[0], x[1], x[2]}))));
+  int minY = std::max(0, static_cast<int>(std::floor(std::min({y[0], y[1], y[2]}))));
+  int maxY = std::min(coverHeight - 1, static_cast<int>(std::ceil(std::max({y[0], y[1], y[2]}))));
+  if (minX > maxX || minY > maxY)
+    return;
+
+  // e_i is opposite vertex i: e_i(px, py) = a_i * px + b_i * py + c_i
+  float a[3], b[3], c[3];
+  for (int i = 0; i < 3; i++)
+  {
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    a[i] = (y[j] - y[k]) * sign;
+    b[i] = (x[k] - x[j]) * sign;
+    c[i] = (x[j] * y[k] - x[k] * y[j]) * sign;
+  }
+
+  for (int py = minY; py <= maxY; py++)
+  {
+    float cy = py + 0.5f;
+    float cx = minX + 0.5f;
+    float e0 = a[0] * cx + b[0] * cy + c[0];
+    float e1 = a[1] * cx + b[1] * cy + c[1];
+    float e2 = a[2] * cx + b[2] * cy + c[2];
+    size_t row = (size_t)(py / scale) * l.width;
+    int bitRow = (py % scale) * scale;
+
+    for (int px = minX; px <= maxX; px++, e0 += a[0], e1 += a[1], e2 += a[2])
+    {
+      if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f)
+        continue;
+      float depth = (e0 * w[0] + e1 * w[1] + e2 * w[2]) * invArea;
+      size_t i = row + px / scale;
+      coveredW[i] = coverage[i] ? std::min(coveredW[i], depth) : depth;
+      coverage[i] |= static_cast<uint16_t>(1u << (bitRow + px % scale));
+    }
+  }
+}
+
+void OcclusionBuffer::buildPyramid()
+{
+  // texels with any pixel left uncovered hide nothing
+  const uint16_t full = static_cast<uint16_t>((1u << (scale * scale)) - 1);
+  Level &base = levels[0];
+  for (size_t i = 0; i < base.minW.size(); i++)
+    base.minW[i] = coverage[i] == full ? coveredW[i] : 0.0f;
+
+  for (size_t n = 1; n < levels.size(); n++)
+  {
+    const Level &src = levels[n - 1];
+    Level &dst = levels[n];
+    // level 0 only has exact depths
+    const std::vector<float> &srcMax = n == 1 ? src.minW : src.maxW;
+
+    for (int ty = 0; ty < dst.height; ty++)
+    {
+      int y0 = ty * 2, y1 = std::min(ty * 2 + 1, src.height - 1);
+      for (int tx = 0; tx < dst.width; tx++)
+      {
+        int x0 = tx * 2, x1 = std::min(tx * 2 + 1, src.width - 1);
+        size_t i00 = (size_t)y0 * src.width + x0, i01 = (size_t)y0 * src.width + x1;
+        size_t i10 = (size_t)y1 * src.width + x0, i11 = (size_t)y1 * src.width + x1;
+        size_t d = (size_t)ty * dst.width + tx;
+        dst.minW[d] = std::min({src.minW[i00], src.minW[i01], src.minW[i10], src.minW[i11]});
+        dst.maxW[d] = std::max({srcMax[i00], srcMax[i01], srcMax[i10], srcMax[i11]});
+      }
+    }
+  }
+}
+
+bool OcclusionBuffer::regionOccluded(int level, int tx, int ty, int x0, int y0, int x1, int y1, float nearestW) const
+{
+  const Level &l = levels[level];
+  size_t i = (size_t)ty * l.width + tx;
+
+  // behind the farthest occluder depth of the whole texel
+  if (nearestW < l.minW[i])
+    return true;
+  // no pixel of the texel is nearer than the object
+  if (level == 0 || nearestW >= l.maxW[i])
+    return false;
+
+  const Level &child = levels[level - 1];
+  int shift = level - 1;
+  for (int cy = ty * 2; cy <= std::min(ty * 2 + 1, child.height - 1); cy++)
+  {
+    if ((cy << shift) >= y1 || ((cy + 1) << shift) <= y0)
+      continue;
+    for (int cx = tx * 2; cx <= std::min(tx * 2 + 1, child.width - 1); cx++)
+    {
+      if ((cx << shift) >= x1 || ((cx + 1) << shift) <= x0)
+        continue;
+      if (!regionOccluded(level - 1, cx, cy, x0, y0, x1, y1, nearestW))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool OcclusionBuffer::isOccluded(int x0, int y0, int x1, int y1, float nearestW) const
+{
+  if (levels.empty())
+    return false;
+
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, levels[0].width);
+  y1 = std::min(y1, levels[0].height);
+  if (x0 >= x1 || y0 >= y1)
+    return false;
+
+  // start where the rectangle spans at most 2x2 texels
+  int level = 0;
+  while (level + 1 < static_cast<int>(levels.size()) &&
+         (((x1 - 1) >> level) - (x0 >> level) > 1 || ((y1 - 1) >> level) - (y0 >> level) > 1))
+    level++;
+
+  for (int ty = y0 >> level; ty <= (y1 - 1) >> level; ty++)
+    for (int tx = x0 >> level; tx <= (x1 - 1) >> level; tx++)
+      if (!regionOccluded(level, tx, ty, x0, y0, x1, y1, nearestW))
+        return false;
+  return true;
+}
@@ -0,0 +1,123 @@
+#include "texture.hpp"
+#include "utility.hpp"
+#include "resourceCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static void setupTexture(Texture &t, int w, int h, Texture::Layout l)
+{
+  t.width = w;
+  t.height = h;
+  t.layout = l;
+  t.pow2 = w > 0 && h > 0 && (w & (w - 1)) == 0 && (h & (h - 1)) == 0;
+  t.maskX = w - 1;
+  t.maskY = h - 1;
+  // tiled rows are padded to whole blocks, padding texels are never addressed
+  t.stride = l == Texture::linear ? w : (w + Texture::BLOCK_SIZE - 1) / Texture::BLOCK_SIZE;
+}
+
+size_t Texture::texelCount() const
+{
+  if (layout == linear)
+    return (size_t)width * height;
+
+  int blockRows = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  return (size_t)stride * blockRows * BLOCK_SIZE * BLOCK_SIZE;
+}
+
+void Texture::create(int w, int h, const uint8_t *rgba, Layout l)
+{
+  setupTexture(*this, w, h, l);
+  size_t count = texelCount();
+
+  storage.reset(static_cast<uint32_t *>(_mm_malloc(count * sizeof(uint32_t), 64)));
+  if (!storage) {
+    throw std::runtime_error("Failed to allocate texture");
+  }
+  memset(storage.get(), 0, count * sizeof(uint32_t));
+  texels = storage.get();
+
+  for (int y = 0; y < h; y++)
+  {
+    for (int x = 0; x < w; x++)
+    {
+      uint32_t texel;
+      memcpy(&texel, &rgba[(y * w + x) * 4], sizeof(texel));
+      storage[index(x, y)] = texel;
+    }
+  }
+}
+
+void Texture::createView(int w, int h, const uint32_t *data, Layout l)
+{
+  setupTexture(*this, w, h, l);
+  storage.reset();
+  texels = data;
+}
+
+size_t Texture::memoryUsed() const
+{
+  size_t bytes = storage ? texelCount() * sizeof(uint32_t) : 0;
+  for (const Texture &m : mips)
+    bytes += m.memoryUsed();
+  return bytes;
+}
+
+uint64_t Texture::contentHash() const
+{
+  uint64_t h = HashBytes(&width, sizeof(int) * 2, layout);
+  return HashBytes(texels, texelCount() * sizeof(uint32_t), h);
+}
+
+// mips are built from level 0, so comparing it covers them
+bool Texture::sameContent(const Texture &other) const
+{
+  return width == other.width && height == other.height && layout == other.layout &&
+         memcmp(texels, other.texels, texelCount() * sizeof(uint32_t)) == 0;
+}
+
+void Texture::generateMips()
+{
+  mips.clear();
+
+  std::vector<uint8_t> rgba;
+  const Texture *src = this;
+  while (src->width > 1 || src->height > 1)
+  {
+    int w = std::max(1, src->width / 2);
+    int h = std::max(1, src->height / 2);
+    rgba.resize((size_t)w * h * 4);
+
+    // 2x2 box, odd sizes fold their last row / column into the edge texels
+    for (int y = 0; y < h; y++)
+    {
+      int y0 = std::min(y * 2, src->height - 1);
+      int y1 = std::min(y * 2 + 1, src->height - 1);
+      for (int x = 0; x < w; x++)
+      {
+        int x0 = std::min(x * 2, src->width - 1);
+        int x1 = std::min(x * 2 + 1, src->width - 1);
+        uint32_t t[4] = {src->fetch(x0, y0), src->fetch(x1, y0), src->fetch(x0, y1), src->fetch(x1, y1)};
+
+        uint8_t *out = &rgba[((size_t)y * w + x) * 4];
+        for (int c = 0; c < 4; c++)
+        {
+          int shift = c * 8;
+          int sum = ((t[0] >> shift) & 0xFF) + ((t[1] >> shift) & 0xFF) + ((t[2] >> shift) & 0xFF) + ((t[3] >> shift) & 0xFF);
+          out[c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+
+        Color color = {out[0], out[1], out[2]};
+        Color quantized = quantise(color);
+        out[0] = quantized.r;
+        out[1] = quantized.g;
+        out[2] = quantized.b;
+      }
+    }
+
+    mips.emplace_back();
+    mips.back().create(w, h, rgba.data(), layout);
+    src = &mips.back();
+  }
+}
@@ -0,0 +1,141 @@
+#include "threadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+  stopping = false;
+
+  if (numThreads == 0)
+  {
+    numThreads = std::thread::hardware_concurrency();
+    // the thread calling parallelFor() works too
+    numThreads = numThreads > 1 ? numThreads - 1 : 0;
+  }
+
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  workCv.notify_all();
+
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::size() const
+{
+  return workers.size() + 1;
+}
+
+// Claims one index of the front batch (or of 'batch' when given) and runs it
+// with the lock released. Returns false if there was nothing to claim.
+bool ThreadPool::runOne(std::unique_lock<std::mutex> &lock, Batch *batch)
+{
+  if (queue.empty())
+    return false;
+
+  Batch *b = batch ? batch : queue.front();
+  if (b->next >= b->count)
+    return false;
+
+  size_t index = b->next++;
+  if (b->next == b->count)
+  {
+    for (auto it = queue.begin(); it != queue.end(); ++it)
+    {
+      if (*it == b)
+      {
+        queue.erase(it);
+        break;
+      }
+    }
+  }
+
+  lock.unlock();
+  (*b->job)(index);
+  lock.lock();
+
+  if (++b->done == b->count)
+    doneCv.notify_all();
+
+  return true;
+}
+
+void ThreadPool::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (true)
+  {
+    workCv.wait(lock, [this]
+                { return stopping || !queue.empty() || !tasks.empty(); });
+
+    if (runOne(lock, nullptr))
+      continue;
+
+    // queued tasks still run when stopping, their callers may wait on results
+    if (tasks.empty())
+    {
+      if (stopping)
+        return;
+      continue;
+    }
+
+    std::function<void()> task = std::move(tasks.front());
+    tasks.pop_front();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  if (workers.empty())
+  {
+    task();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  workCv.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &job)
+{
+  if (count == 0)
+    return;
+
+  if (workers.empty() || count == 1)
+  {
+    for (size_t i = 0; i < count; i++)
+      job(i);
+    return;
+  }
+
+  Batch batch = {&job, count, 0, 0};
+
+  std::unique_lock<std::mutex> lock(mutex);
+  queue.push_back(&batch);
+  workCv.notify_all();
+
+  while (runOne(lock, &batch))
+  {
+  }
+
+  doneCv.wait(lock, [&batch]
+              { return batch.done == batch.count; });
+}
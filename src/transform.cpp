@@ -1,49 +1,46 @@
 #include "transform.hpp"
-#include <iostream>
 
 Transform::Transform()
 {
+  pos = {0, 0, 0};
   calculateAngles(0, 0, 0);
 }
 Transform::~Transform() {}
 
-void Transform::setupMatrix(mat4x4 &m3)
+void Transform::setPosition(const Vec3 &p)
 {
-
-  matWorld = Matrix_MakeIdentity();
-  matWorld = Matrix_MultiplyMatrix(matRotY, matRotX);
-  matWorld = Matrix_MultiplyMatrix(matWorld, m3);
+  pos = p;
+  dirty = true;
 }
 
 void Transform::calculateAngles(float angleX, float angleY, float angleZ)
 {
-  // std::cout << "Calculating angles: angleX=" << angleX << " angleY=" << angleY << " angleZ=" << angleZ << std::endl;
-  matRotX = Matrix_MakeRotationX(angleX);
-  matRotY = Matrix_MakeRotationY(angleY);
-  matRotZ = Matrix_MakeRotationZ(angleZ);
+  rot = {angleX, angleY, angleZ};
+  mat4x4 matRotX = Matrix_MakeRotationX(angleX);
+  mat4x4 matRotY = Matrix_MakeRotationY(angleY);
+  mat4x4 matRotZ = Matrix_MakeRotationZ(angleZ);
 
-  // Debug output for rotation matrices
-  // std::cout << "Rotation Matrix X (from angleX input):\\n";
-  // for (int i = 0; i < 4; ++i) {
-  //   for (int j = 0; j < 4; ++j) {
-  //     std::cout << matRotX.m[i][j] << " ";
-  //   }
-  //   std::cout << std::endl;
-  // }
+  matRotation = Matrix_MultiplyMatrix(matRotZ, matRotY);
+  matRotation = Matrix_MultiplyMatrix(matRotation, matRotX);
+  dirty = true;
+}
 
-  // std::cout << "Rotation Matrix Y (from angleY input):\\n";
-  // for (int i = 0; i < 4; ++i) {
-  //   for (int j = 0; j < 4; ++j) {
-  //     std::cout << matRotY.m[i][j] << " ";
-  //   }
-  //   std::cout << std::endl;
-  // }
+void Transform::updateWorld(const mat4x4 *parentWorld)
+{
+  // rotation followed by the translation only replaces the last row
+  mat4x4 matLocal = matRotation;
+  matLocal.m[3][0] = pos.x;
+  matLocal.m[3][1] = pos.y;
+  matLocal.m[3][2] = pos.z;
 
-  // std::cout << "Rotation Matrix Z (from angleZ input):\\n";
-  // for (int i = 0; i < 4; ++i) {
-  //   for (int j = 0; j < 4; ++j) {
-  //     std::cout << matRotZ.m[i][j] << " ";
-  //   }
-  //   std::cout << std::endl;
-  // }
+  if (parentWorld)
+  {
+    mat4x4 matParent = *parentWorld;
+    matWorld = Matrix_MultiplyMatrix(matLocal, matParent);
+  }
+  else
+  {
+    matWorld = matLocal;
+  }
+  dirty = false;
 }
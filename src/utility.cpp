@@ -1,4 +1,5 @@
 #include "utility.hpp"
+#include <utility>
 
 float sintable[360];
 float costable[360];
@@ -23,6 +24,24 @@ Vec3 Matrix_MultiplyVector(mat4x4 &m, Vec3 &i)
   return v;
 }
 
+AABB AABB_Transform(const AABB &box, const mat4x4 &m)
+{
+  float c[3] = {(box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f};
+  float e[3] = {(box.max.x - box.min.x) * 0.5f, (box.max.y - box.min.y) * 0.5f, (box.max.z - box.min.z) * 0.5f};
+
+  float center[3], extent[3];
+  for (int j = 0; j < 3; j++)
+  {
+    center[j] = c[0] * m.m[0][j] + c[1] * m.m[1][j] + c[2] * m.m[2][j] + m.m[3][j];
+    extent[j] = e[0] * fabsf(m.m[0][j]) + e[1] * fabsf(m.m[1][j]) + e[2] * fabsf(m.m[2][j]);
+  }
+
+  AABB r;
+  r.min = {center[0] - extent[0], center[1] - extent[1], center[2] - extent[2]};
+  r.max = {center[0] + extent[0], center[1] + extent[1], center[2] + extent[2]};
+  return r;
+}
+
 mat4x4 Matrix_MakeIdentity()
 {
   mat4x4 matrix;
@@ -391,6 +410,95 @@ int Triangle_CLipAgainstPlane(Vec3 &plane_p, Vec3 &plane_n, Triangle &in_tri, Tr
   return 0; // Default return, though theoretically unreachable
 }
 
+int Triangle_ClipAgainstRect(const Triangle &in_tri, float minX, float minY, float maxX, float maxY, Triangle out_tris[5])
+{
+  struct ClipVertex
+  {
+    Vec3 p;
+    UV t;
+  };
+
+  // every plane adds at most one vertex, 3 + 4 planes
+  ClipVertex bufferA[8];
+  ClipVertex bufferB[8];
+  ClipVertex *in = bufferA;
+  ClipVertex *out = bufferB;
+  int nIn = 3;
+
+  for (int i = 0; i < 3; i++)
+  {
+    in[i] = {in_tri.p[i], in_tri.t[i]};
+  }
+
+  // signed distance to each axis aligned plane, positive is inside
+  auto dist = [&](const ClipVertex &v, int plane)
+  {
+    switch (plane)
+    {
+    case 0:
+      return v.p.y - minY;
+    case 1:
+      return maxY - v.p.y;
+    case 2:
+      return v.p.x - minX;
+    default:
+      return maxX - v.p.x;
+    }
+  };
+
+  // always interpolate from the inside vertex so shared edges clip identically
+  auto intersect = [](const ClipVertex &inside, const ClipVertex &outside, float dIn, float dOut)
+  {
+    float t = dIn / (dIn - dOut);
+    ClipVertex v;
+    v.p.x = inside.p.x + t * (outside.p.x - inside.p.x);
+    v.p.y = inside.p.y + t * (outside.p.y - inside.p.y);
+    v.p.z = inside.p.z + t * (outside.p.z - inside.p.z);
+    v.t.u = inside.t.u + t * (outside.t.u - inside.t.u);
+    v.t.v = inside.t.v + t * (outside.t.v - inside.t.v);
+    v.t.w = inside.t.w + t * (outside.t.w - inside.t.w);
+    return v;
+  };
+
+  for (int plane = 0; plane < 4 && nIn > 0; plane++)
+  {
+    int nOut = 0;
+
+    for (int i = 0; i < nIn; i++)
+    {
+      const ClipVertex &a = in[i];
+      const ClipVertex &b = in[(i + 1) % nIn];
+      float da = dist(a, plane);
+      float db = dist(b, plane);
+
+      if (da >= 0)
+        out[nOut++] = a;
+
+      if ((da >= 0) != (db >= 0))
+        out[nOut++] = da >= 0 ? intersect(a, b, da, db) : intersect(b, a, db, da);
+    }
+
+    std::swap(in, out);
+    nIn = nOut;
+  }
+
+  int nTris = 0;
+  for (int i = 1; i + 1 < nIn; i++)
+  {
+    Triangle &t = out_tris[nTris++];
+    t.p[0] = in[0].p;
+    t.t[0] = in[0].t;
+    t.p[1] = in[i].p;
+    t.t[1] = in[i].t;
+    t.p[2] = in[i + 1].p;
+    t.t[2] = in[i + 1].t;
+    t.color = in_tri.color;
+    t.textureID = in_tri.textureID;
+  }
+
+  return nTris;
+}
+
 Color quantise(Color &color)
 {
   constexpr int nBits = 5;
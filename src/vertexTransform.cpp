@@ -0,0 +1,111 @@
+#include "vertexTransform.hpp"
+#include "fixed.hpp"
+#include <algorithm>
+#include <immintrin.h>
+
+/*
+  Batched point transform over SoA streams.
+
+  Each matrix element is broadcast once per call, then every output component
+  is x * m[0][c] + y * m[1][c] + z * m[2][c] + m[3][c] for 8 (AVX) or 4 (SSE)
+  vertices per instruction. The remaining vertices go through the same
+  formula in scalar code.
+*/
+
+namespace
+{
+  inline void transformScalar(const mat4x4 &m, float x, float y, float z,
+                              float &ox, float &oy, float &oz, float *ow)
+  {
+    ox = x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0] + m.m[3][0];
+    oy = x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1] + m.m[3][1];
+    oz = x * m.m[0][2] + y * m.m[1][2] + z * m.m[2][2] + m.m[3][2];
+    if (ow)
+      *ow = x * m.m[0][3] + y * m.m[1][3] + z * m.m[2][3] + m.m[3][3];
+  }
+}
+
+void TransformPositions(const mat4x4 &m, const float *x, const float *y, const float *z, size_t count,
+                        float *ox, float *oy, float *oz, float *ow)
+{
+  size_t i = 0;
+
+#ifdef __AVX__
+  __m256 m00 = _mm256_set1_ps(m.m[0][0]), m01 = _mm256_set1_ps(m.m[0][1]);
+  __m256 m02 = _mm256_set1_ps(m.m[0][2]), m03 = _mm256_set1_ps(m.m[0][3]);
+  __m256 m10 = _mm256_set1_ps(m.m[1][0]), m11 = _mm256_set1_ps(m.m[1][1]);
+  __m256 m12 = _mm256_set1_ps(m.m[1][2]), m13 = _mm256_set1_ps(m.m[1][3]);
+  __m256 m20 = _mm256_set1_ps(m.m[2][0]), m21 = _mm256_set1_ps(m.m[2][1]);
+  __m256 m22 = _mm256_set1_ps(m.m[2][2]), m23 = _mm256_set1_ps(m.m[2][3]);
+  __m256 m30 = _mm256_set1_ps(m.m[3][0]), m31 = _mm256_set1_ps(m.m[3][1]);
+  __m256 m32 = _mm256_set1_ps(m.m[3][2]), m33 = _mm256_set1_ps(m.m[3][3]);
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 vz = _mm256_loadu_ps(z + i);
+
+    _mm256_storeu_ps(ox + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m00), _mm256_mul_ps(vy, m10)), _mm256_mul_ps(vz, m20)), m30));
+    _mm256_storeu_ps(oy + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m01), _mm256_mul_ps(vy, m11)), _mm256_mul_ps(vz, m21)), m31));
+    _mm256_storeu_ps(oz + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m02), _mm256_mul_ps(vy, m12)), _mm256_mul_ps(vz, m22)), m32));
+    if (ow)
+      _mm256_storeu_ps(ow + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m03), _mm256_mul_ps(vy, m13)), _mm256_mul_ps(vz, m23)), m33));
+  }
+#else
+  __m128 m00 = _mm_set1_ps(m.m[0][0]), m01 = _mm_set1_ps(m.m[0][1]);
+  __m128 m02 = _mm_set1_ps(m.m[0][2]), m03 = _mm_set1_ps(m.m[0][3]);
+  __m128 m10 = _mm_set1_ps(m.m[1][0]), m11 = _mm_set1_ps(m.m[1][1]);
+  __m128 m12 = _mm_set1_ps(m.m[1][2]), m13 = _mm_set1_ps(m.m[1][3]);
+  __m128 m20 = _mm_set1_ps(m.m[2][0]), m21 = _mm_set1_ps(m.m[2][1]);
+  __m128 m22 = _mm_set1_ps(m.m[2][2]), m23 = _mm_set1_ps(m.m[2][3]);
+  __m128 m30 = _mm_set1_ps(m.m[3][0]), m31 = _mm_set1_ps(m.m[3][1]);
+  __m128 m32 = _mm_set1_ps(m.m[3][2]), m33 = _mm_set1_ps(m.m[3][3]);
+
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 vx = _mm_loadu_ps(x + i);
+    __m128 vy = _mm_loadu_ps(y + i);
+    __m128 vz = _mm_loadu_ps(z + i);
+
+    _mm_storeu_ps(ox + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m00), _mm_mul_ps(vy, m10)), _mm_mul_ps(vz, m20)), m30));
+    _mm_storeu_ps(oy + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m01), _mm_mul_ps(vy, m11)), _mm_mul_ps(vz, m21)), m31));
+    _mm_storeu_ps(oz + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m02), _mm_mul_ps(vy, m12)), _mm_mul_ps(vz, m22)), m32));
+    if (ow)
+      _mm_storeu_ps(ow + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m03), _mm_mul_ps(vy, m13)), _mm_mul_ps(vz, m23)), m33));
+  }
+#endif
+
+  for (; i < count; i++)
+    transformScalar(m, x[i], y[i], z[i], ox[i], oy[i], oz[i], ow ? ow + i : nullptr);
+}
+
+void TransformPositionsFixed(const mat4x4 &m, const float *x, const float *y, const float *z, size_t count,
+                             int32_t *ox, int32_t *oy, int32_t *ow)
+{
+  // with |m| < 2^30 and |p| < 2^31 the three products and the translation fit in 64 bits
+  constexpr int64_t MATRIX_LIMIT = int64_t(1) << 30;
+  constexpr int64_t POINT_LIMIT = INT32_MAX;
+
+  int64_t fm[4][4];
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+      fm[r][c] = saturateFixed16(m.m[r][c], MATRIX_LIMIT);
+
+  // rounded back to 16.16 and saturated
+  auto toClip = [](int64_t v)
+  {
+    return static_cast<int32_t>(std::clamp<int64_t>((v + FIXED_ONE / 2) >> FIXED_SHIFT, INT32_MIN, INT32_MAX));
+  };
+
+  for (size_t i = 0; i < count; i++)
+  {
+    int64_t px = saturateFixed16(x[i], POINT_LIMIT);
+    int64_t py = saturateFixed16(y[i], POINT_LIMIT);
+    int64_t pz = saturateFixed16(z[i], POINT_LIMIT);
+
+    ox[i] = toClip(px * fm[0][0] + py * fm[1][0] + pz * fm[2][0] + fm[3][0] * FIXED_ONE);
+    oy[i] = toClip(px * fm[0][1] + py * fm[1][1] + pz * fm[2][1] + fm[3][1] * FIXED_ONE);
+    ow[i] = toClip(px * fm[0][3] + py * fm[1][3] + pz * fm[2][3] + fm[3][3] * FIXED_ONE);
+  }
+}